@@ -0,0 +1,525 @@
+/**
+ * cpp-html benchmarks. Measures parsing, tokenizing, DOM queries and
+ * serialization on the test fixtures and synthetic documents and prints
+ * results as JSON, so they could be compared between releases.
+ *
+ * Synthetic documents of every shape are generated in sizes from 1 KB up to
+ * --max-size growing 16 times each step, so it's visible how parsing and
+ * DOM operations scale.
+ *
+ * With --memory only memory used by parsed documents is reported: bytes
+ * per input byte, per node and their breakdown by node type.
+ *
+ * Usage: cpp-html-bench [--memory] [--min-time seconds] [--max-size size]
+ *	[--seed n] [html_file...]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cpp-html/attribute.hpp>
+#include <cpp-html/document.hpp>
+#include <cpp-html/node.hpp>
+#include <cpp-html/parser.hpp>
+#include <cpp-html/tokenizer.hpp>
+
+#include "html_generator.hpp"
+
+
+//
+// Allocation counting. Global operators are replaced for the whole program,
+// including the library.
+//
+
+namespace
+{
+
+std::atomic<std::size_t> allocation_count(0);
+std::atomic<std::size_t> allocated_bytes(0);
+
+
+void*
+counted_alloc(std::size_t size)
+{
+	++allocation_count;
+	allocated_bytes += size;
+
+	void* ptr = std::malloc(size ? size : 1);
+	if (ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+} // namespace.
+
+
+void*
+operator new(std::size_t size)
+{
+	return counted_alloc(size);
+}
+
+
+void*
+operator new[](std::size_t size)
+{
+	return counted_alloc(size);
+}
+
+
+void
+operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+
+void
+operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+
+namespace
+{
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+struct allocation_stats {
+	std::size_t count;
+	std::size_t bytes;
+};
+
+
+/**
+ * Counts allocations made by the function.
+ */
+template <typename Function>
+allocation_stats
+count_allocations(Function function)
+{
+	std::size_t count = allocation_count;
+	std::size_t bytes = allocated_bytes;
+	function();
+
+	return allocation_stats{allocation_count - count, allocated_bytes - bytes};
+}
+
+
+/**
+ * Runs the function repeatedly for at least min_time seconds.
+ *
+ * @return average time of a single run in seconds.
+ */
+template <typename Function>
+double
+measure(double min_time, Function function)
+{
+	// Warm up caches.
+	function();
+
+	std::size_t runs = 0;
+	auto start = bench_clock::now();
+	double elapsed = 0;
+	do {
+		function();
+		++runs;
+		elapsed = std::chrono::duration<double>(bench_clock::now()
+			- start).count();
+	} while (elapsed < min_time);
+
+	return elapsed / runs;
+}
+
+
+std::string
+read_file(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+
+	std::ostringstream content;
+	content << file.rdbuf();
+	return content.str();
+}
+
+
+struct bench_input {
+	std::string name;
+	std::string html;
+};
+
+
+class json_writer {
+public:
+	json_writer(std::ostream& out) : out_(out)
+	{
+		this->out_ << std::setprecision(6);
+	}
+
+	template <typename Value> json_writer&
+	field(const std::string& name, const Value& value)
+	{
+		this->separator();
+		this->write_string(name);
+		this->out_ << ": " << value;
+		return *this;
+	}
+
+	json_writer&
+	field(const std::string& name, const std::string& value)
+	{
+		this->separator();
+		this->write_string(name);
+		this->out_ << ": ";
+		this->write_string(value);
+		return *this;
+	}
+
+	json_writer&
+	begin(const std::string& name = "", char bracket = '{')
+	{
+		this->separator();
+		if (!name.empty()) {
+			this->write_string(name);
+			this->out_ << ": ";
+		}
+		this->out_ << bracket;
+		this->first_ = true;
+		return *this;
+	}
+
+	json_writer&
+	end(char bracket = '}')
+	{
+		this->out_ << bracket;
+		this->first_ = false;
+		return *this;
+	}
+
+private:
+	std::ostream& out_;
+	bool first_ = true;
+
+	void
+	separator()
+	{
+		if (!this->first_) {
+			this->out_ << ", ";
+		}
+		this->first_ = false;
+	}
+
+	/**
+	 * Writes quoted string escaping quotes, backslashes and control
+	 * characters, e.g. in input file names.
+	 */
+	void
+	write_string(const std::string& value)
+	{
+		this->out_ << '"';
+		for (char ch : value) {
+			switch (ch) {
+			case '"':
+				this->out_ << "\\\"";
+				break;
+			case '\\':
+				this->out_ << "\\\\";
+				break;
+			case '\n':
+				this->out_ << "\\n";
+				break;
+			case '\r':
+				this->out_ << "\\r";
+				break;
+			case '\t':
+				this->out_ << "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(ch) < 0x20) {
+					this->out_ << "\\u" << std::hex
+						<< std::setw(4) << std::setfill('0')
+						<< static_cast<int>(ch) << std::dec
+						<< std::setfill(' ');
+				}
+				else {
+					this->out_ << ch;
+				}
+			}
+		}
+		this->out_ << '"';
+	}
+};
+
+
+double
+mb_per_second(std::size_t bytes, double seconds)
+{
+	return bytes / seconds / (1024 * 1024);
+}
+
+
+const char*
+node_type_name(std::size_t type)
+{
+	static const char* names[] = {"null", "document", "element",
+		"attribute", "pcdata", "cdata", "comment", "pi", "declaration",
+		"doctype"};
+
+	return names[type];
+}
+
+
+void
+report_memory_usage(const bench_input& input, json_writer& json)
+{
+	cpphtml::parser parser(cpphtml::parser::parse_full);
+	auto doc = parser.parse(input.html);
+	auto usage = doc->memory_usage();
+	std::size_t total_bytes = usage.total_bytes();
+
+	json.begin().field("input", input.name)
+		.field("bytes", input.html.size())
+		.field("nodes", usage.total_node_count())
+		.field("memory_bytes", total_bytes)
+		.field("bytes_per_input_byte",
+			static_cast<double>(total_bytes) / input.html.size())
+		.field("bytes_per_node",
+			static_cast<double>(total_bytes) / usage.total_node_count())
+		.field("container_bytes", usage.container_bytes);
+
+	json.begin("node_types");
+	for (std::size_t type = 0;
+		type < cpphtml::document_memory_usage::node_type_count; ++type) {
+		if (usage.node_count[type] == 0) {
+			continue;
+		}
+
+		json.begin(node_type_name(type))
+			.field("count", usage.node_count[type])
+			.field("node_bytes", usage.node_bytes[type])
+			.field("string_bytes", usage.string_bytes[type])
+			.end();
+	}
+	json.end();
+
+	json.end();
+}
+
+
+void
+run_benchmarks(const bench_input& input, double min_time, json_writer& json)
+{
+	const std::string& html = input.html;
+	json.begin().field("input", input.name).field("bytes", html.size());
+
+	// Parsing.
+	std::shared_ptr<cpphtml::document> doc;
+	auto allocations = count_allocations([&]() {
+		cpphtml::parser parser;
+		doc = parser.parse(html);
+	});
+
+	std::size_t node_count = 0;
+	doc->traverse([&](std::shared_ptr<cpphtml::node>) {
+		++node_count;
+		return true;
+	});
+
+	cpphtml::parse_stats stats;
+	{
+		cpphtml::parser parser;
+		parser.collect_stats(&stats);
+		parser.parse(html);
+	}
+
+	double parse_time = measure(min_time, [&]() {
+		cpphtml::parser parser;
+		parser.parse(html);
+	});
+	double lazy_parse_time = measure(min_time, [&]() {
+		cpphtml::parser parser(cpphtml::parser::parse_default
+			| cpphtml::parser::parse_lazy_attributes);
+		parser.parse(html);
+	});
+
+	json.field("nodes", node_count)
+		.begin("parse")
+		.field("us", parse_time * 1e6)
+		.field("mb_per_s", mb_per_second(html.size(), parse_time))
+		.field("nodes_per_s", node_count / parse_time)
+		.field("allocations", allocations.count)
+		.field("allocated_bytes", allocations.bytes)
+		.field("elements", stats.elements)
+		.field("text_nodes", stats.text_nodes)
+		.field("attributes", stats.attributes)
+		.field("implied_end_tags", stats.implied_end_tags)
+		.field("raw_text_bytes", stats.raw_text_bytes)
+		.field("max_depth", stats.max_depth)
+		.field("tag_us", stats.tag_time.count() / 1e3)
+		.field("text_us", stats.text_time.count() / 1e3)
+		.field("raw_text_us", stats.raw_text_time.count() / 1e3)
+		.end();
+	json.begin("parse_lazy_attributes")
+		.field("us", lazy_parse_time * 1e6)
+		.field("mb_per_s", mb_per_second(html.size(), lazy_parse_time))
+		.end();
+
+	// Tokenizing.
+	std::size_t token_count = 0;
+	double tokenize_time = measure(min_time, [&]() {
+		token_count = 0;
+		for (cpphtml::token_iterator it_token(html); it_token.has_next();
+			++it_token) {
+			++token_count;
+		}
+	});
+	json.begin("token_iterator")
+		.field("mb_per_s", mb_per_second(html.size(), tokenize_time))
+		.field("tokens_per_s", token_count / tokenize_time)
+		.end();
+
+	double indexed_tokenize_time = measure(min_time, [&]() {
+		token_count = 0;
+		for (cpphtml::indexed_token_iterator it_token(html);
+			it_token.has_next(); ++it_token) {
+			++token_count;
+		}
+	});
+	json.begin("indexed_token_iterator")
+		.field("mb_per_s", mb_per_second(html.size(),
+			indexed_tokenize_time))
+		.field("tokens_per_s", token_count / indexed_tokenize_time)
+		.end();
+
+	// DOM queries. The last id in the document is looked up, so the
+	// whole tree is searched.
+	std::string last_id;
+	doc->traverse([&](std::shared_ptr<cpphtml::node> node) {
+		auto id = node->get_attribute("ID");
+		if (id) {
+			last_id = id->value();
+		}
+		return true;
+	});
+
+	double traverse_time = measure(min_time, [&]() {
+		doc->traverse([](std::shared_ptr<cpphtml::node>) {
+			return true;
+		});
+	});
+	double find_nodes_time = measure(min_time, [&]() {
+		doc->find_nodes([](std::shared_ptr<cpphtml::node> node) {
+			return node->name() == "A";
+		});
+	});
+	double get_element_by_id_time = measure(min_time, [&]() {
+		doc->get_element_by_id(last_id);
+	});
+	double get_elements_by_tag_name_time = measure(min_time, [&]() {
+		doc->get_elements_by_tag_name("DIV");
+	});
+	json.field("traverse_us", traverse_time * 1e6)
+		.field("find_nodes_us", find_nodes_time * 1e6)
+		.field("get_element_by_id_us", get_element_by_id_time * 1e6)
+		.field("get_elements_by_tag_name_us",
+			get_elements_by_tag_name_time * 1e6);
+
+	// Serialization.
+	std::size_t output_size = 0;
+	double to_string_time = measure(min_time, [&]() {
+		output_size = doc->to_string().size();
+	});
+	json.begin("to_string")
+		.field("bytes", output_size)
+		.field("mb_per_s", mb_per_second(output_size, to_string_time))
+		.end();
+
+	json.end();
+}
+
+} // namespace.
+
+
+int
+main(int argc, char* argv[])
+{
+	double min_time = 0.2;
+	bool memory_only = false;
+	std::size_t max_size = 256 * 1024;
+	std::uint32_t seed = 1;
+	std::vector<bench_input> inputs;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--memory") {
+				memory_only = true;
+			}
+			else if (arg == "--min-time" && i + 1 < argc) {
+				min_time = std::stod(argv[++i]);
+			}
+			else if (arg == "--max-size" && i + 1 < argc) {
+				max_size = cpphtml::bench::parse_size(argv[++i]);
+			}
+			else if (arg == "--seed" && i + 1 < argc) {
+				seed = std::stoul(argv[++i]);
+			}
+			else {
+				inputs.push_back(bench_input{arg, read_file(arg)});
+			}
+		}
+
+		if (inputs.empty()) {
+			inputs.push_back(bench_input{"craigslist_newyork_index.html",
+				read_file(BENCH_FIXTURE_DIR
+				"/craigslist_newyork_index.html")});
+			for (auto shape : cpphtml::bench::all_shapes()) {
+				for (std::size_t size = 1024; size <= max_size;
+					size *= 16) {
+					auto options = cpphtml::bench::
+						default_generator_options(shape, size, seed);
+					inputs.push_back(bench_input{std::string(
+						cpphtml::bench::shape_name(shape)) + "_"
+						+ std::to_string(size / 1024) + "k",
+						cpphtml::bench::generate_html(options)});
+				}
+			}
+		}
+
+		json_writer json(std::cout);
+		json.begin().begin("benchmarks", '[');
+		for (auto& input : inputs) {
+			if (memory_only) {
+				report_memory_usage(input, json);
+			}
+			else {
+				run_benchmarks(input, min_time, json);
+			}
+		}
+		json.end(']').end();
+		std::cout << std::endl;
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * Writes synthetic HTML document to stdout.
+ *
+ * Usage: cpp-html-generate [--shape name] [--size size] [--seed n]
+ *	[--max-depth n] [--max-width n]
+ *
+ * Size might have a suffix k, m or g, e.g. 64k or 1g.
+ */
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "html_generator.hpp"
+
+
+using namespace cpphtml::bench;
+
+
+namespace
+{
+
+void
+print_usage()
+{
+	std::cerr << "Usage: cpp-html-generate [--shape name] [--size size] "
+		"[--seed n] [--max-depth n] [--max-width n]\n\nShapes:";
+	for (auto shape : all_shapes()) {
+		std::cerr << ' ' << shape_name(shape);
+	}
+	std::cerr << std::endl;
+}
+
+} // namespace.
+
+
+int
+main(int argc, char* argv[])
+{
+	auto options = default_generator_options(document_shape::mixed,
+		64 * 1024);
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (i + 1 >= argc) {
+				print_usage();
+				return 1;
+			}
+
+			std::string value = argv[++i];
+			if (arg == "--shape") {
+				options.shape = shape_from_name(value);
+			}
+			else if (arg == "--size") {
+				options.size = parse_size(value);
+			}
+			else if (arg == "--seed") {
+				options.seed = std::stoul(value);
+			}
+			else if (arg == "--max-depth") {
+				options.max_depth = std::stoul(value);
+			}
+			else if (arg == "--max-width") {
+				options.max_width = std::stoul(value);
+			}
+			else {
+				print_usage();
+				return 1;
+			}
+		}
+
+		std::ios::sync_with_stdio(false);
+		generate_html(options, std::cout);
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		print_usage();
+		return 1;
+	}
+
+	return 0;
+}
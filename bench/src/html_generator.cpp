@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <cctype>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include "html_generator.hpp"
+
+
+namespace cpphtml
+{
+
+namespace bench
+{
+
+namespace
+{
+
+const std::size_t flush_size = 64 * 1024;
+
+
+const char* words[] = {"lorem", "ipsum", "dolor", "sit", "amet",
+	"consectetur", "adipiscing", "elit", "sed", "do", "eiusmod", "tempor",
+	"incididunt", "ut", "labore", "et", "dolore", "magna", "aliqua"};
+
+
+const char* nested_tags[] = {"div", "span", "section", "article", "b", "i",
+	"em", "strong", "a", "blockquote"};
+
+
+const char* entities[] = {"&amp;", "&lt;", "&gt;", "&quot;", "&nbsp;",
+	"&copy;", "&eacute;", "&mdash;", "&hellip;", "&#169;", "&#8364;",
+	"&#x263A;", "&#X41;", "&amp", "&notit;", "&#0;", "&unknown;"};
+
+
+/**
+ * Generates documents of the specified shape. Output is buffered and
+ * flushed to the stream every flush_size bytes.
+ *
+ * Random numbers are taken directly from std::mt19937, whose output is
+ * specified by the standard, so documents are the same on all platforms.
+ */
+class html_generator {
+public:
+	html_generator(const generator_options& options, std::ostream& out)
+		: options_(options), out_(out), rng_(options.seed)
+	{
+		this->buffer_.reserve(flush_size + 4096);
+	}
+
+	void
+	run()
+	{
+		this->emit("<!DOCTYPE html>\n<html><head><title>");
+		this->emit(shape_name(this->options_.shape));
+		this->emit(" ");
+		this->emit(std::to_string(this->options_.seed));
+		this->emit("</title></head>\n<body>\n");
+
+		while (!this->full()) {
+			this->generate_unit(this->options_.shape);
+		}
+
+		this->emit("</body></html>\n");
+		this->flush();
+	}
+
+private:
+	generator_options options_;
+	std::ostream& out_;
+	std::mt19937 rng_;
+	std::string buffer_;
+	std::size_t written_ = 0;
+
+	/**
+	 * @return random number in range [0, n).
+	 */
+	std::size_t
+	random(std::size_t n)
+	{
+		return this->rng_() % n;
+	}
+
+	/**
+	 * @return random number in range [min, max].
+	 */
+	std::size_t
+	random(std::size_t min, std::size_t max)
+	{
+		return min + this->random(max - min + 1);
+	}
+
+	template <typename T, std::size_t N> T&
+	pick(T (&values)[N])
+	{
+		return values[this->random(N)];
+	}
+
+	bool
+	full() const
+	{
+		return this->written_ + this->buffer_.size() >= this->options_.size;
+	}
+
+	void
+	emit(const std::string& str)
+	{
+		this->buffer_ += str;
+		if (this->buffer_.size() >= flush_size) {
+			this->flush();
+		}
+	}
+
+	void
+	flush()
+	{
+		this->out_.write(this->buffer_.data(), this->buffer_.size());
+		this->written_ += this->buffer_.size();
+		this->buffer_.clear();
+	}
+
+	std::string
+	text(std::size_t word_count)
+	{
+		std::string str;
+		for (std::size_t i = 0; i < word_count; ++i) {
+			if (i > 0) {
+				str += ' ';
+			}
+			str += this->pick(words);
+		}
+
+		return str;
+	}
+
+	void
+	generate_unit(document_shape shape)
+	{
+		switch (shape) {
+		case document_shape::mixed:
+			// Skip the mixed shape itself.
+			this->generate_unit(static_cast<document_shape>(
+				this->random(1, all_shapes().size() - 1)));
+			break;
+		case document_shape::deep_nesting:
+			this->deep_nesting();
+			break;
+		case document_shape::wide_siblings:
+			this->wide_siblings();
+			break;
+		case document_shape::attribute_heavy:
+			this->attribute_heavy();
+			break;
+		case document_shape::raw_text:
+			this->raw_text();
+			break;
+		case document_shape::implied_end_tags:
+			this->implied_end_tags();
+			break;
+		case document_shape::entity_dense:
+			this->entity_dense();
+			break;
+		}
+	}
+
+	void
+	deep_nesting()
+	{
+		std::vector<const char*> open_tags;
+		std::size_t depth = this->random(this->options_.max_depth / 2,
+			this->options_.max_depth);
+		while (open_tags.size() < depth && !this->full()) {
+			const char* tag = this->pick(nested_tags);
+			this->emit(std::string("<") + tag + " class=\"d"
+				+ std::to_string(open_tags.size()) + "\">");
+			if (this->random(4) == 0) {
+				this->emit(this->text(this->random(1, 3)));
+			}
+			open_tags.push_back(tag);
+		}
+
+		for (auto it = open_tags.rbegin(); it != open_tags.rend(); ++it) {
+			this->emit(std::string("</") + *it + ">");
+		}
+		this->emit("\n");
+	}
+
+	void
+	wide_siblings()
+	{
+		static const char* parents[][2] = {{"ul", "li"}, {"div", "span"},
+			{"ol", "li"}, {"nav", "a"}};
+
+		auto& tags = this->pick(parents);
+		std::string child_open = std::string("<") + tags[1] + ">";
+		std::string child_close = std::string("</") + tags[1] + ">";
+
+		this->emit(std::string("<") + tags[0] + ">\n");
+		std::size_t width = this->random(this->options_.max_width / 2,
+			this->options_.max_width);
+		for (std::size_t i = 0; i < width && !this->full(); ++i) {
+			this->emit(child_open + this->text(this->random(1, 2)) + " "
+				+ std::to_string(i) + child_close + "\n");
+		}
+		this->emit(std::string("</") + tags[0] + ">\n");
+	}
+
+	void
+	attribute_heavy()
+	{
+		static const char* tags[] = {"div", "a", "input", "img", "span"};
+
+		std::string tag = this->pick(tags);
+		std::string element = "<" + tag;
+		std::size_t attribute_count = this->random(16, 48);
+		for (std::size_t i = 0; i < attribute_count; ++i) {
+			std::string name = "data-" + std::string(this->pick(words))
+				+ "-" + std::to_string(i);
+			switch (this->random(5)) {
+			case 0:
+				element += " " + name + "=\"" + this->text(
+					this->random(1, 4)) + "\"";
+				break;
+			case 1:
+				element += " " + name + "='" + this->text(
+					this->random(1, 2)) + " > \"q\"'";
+				break;
+			case 2:
+				element += " " + name + "=" + this->pick(words);
+				break;
+			case 3:
+				element += " " + name;
+				break;
+			default:
+				element += "\n\t" + name + "=\"" + std::to_string(
+					this->rng_()) + "\"";
+				break;
+			}
+		}
+
+		element += ">";
+		if (tag != "input" && tag != "img") {
+			element += this->text(this->random(1, 5)) + "</" + tag + ">";
+		}
+		this->emit(element + "\n");
+	}
+
+	void
+	raw_text()
+	{
+		bool script = this->random(2) == 0;
+		std::size_t block_size = this->random(4 * 1024, 256 * 1024);
+		std::size_t start = this->written_ + this->buffer_.size();
+
+		this->emit(script ? "<script type=\"text/javascript\">\n"
+			: "<style type=\"text/css\">\n");
+		for (std::size_t i = 0; this->written_ + this->buffer_.size()
+			- start < block_size && !this->full(); ++i) {
+			std::string n = std::to_string(i);
+			if (script) {
+				this->emit("var s" + n + " = \"<div class='" + n
+					+ "'>\" + items[" + n + "] + \"</div>\";\n"
+					"if (i < n && j > " + n + ") { document.write("
+					"'<p>' + s" + n + " + '</p>'); } // </scr\n");
+			}
+			else {
+				this->emit(".c" + n + " > a:hover, #i" + n
+					+ " { color: #" + std::to_string(this->random(
+					100, 999)) + "; content: \"</sty\"; }\n");
+			}
+		}
+		this->emit(script ? "</script>\n" : "</style>\n");
+	}
+
+	void
+	implied_end_tags()
+	{
+		std::size_t count = this->random(4, 32);
+		switch (this->random(4)) {
+		case 0:
+			this->emit("<ul>");
+			for (std::size_t i = 0; i < count; ++i) {
+				this->emit("<li>" + this->text(this->random(1, 4)));
+			}
+			this->emit("</ul>\n");
+			break;
+		case 1:
+			this->emit("<table>");
+			for (std::size_t i = 0; i < count; ++i) {
+				this->emit("<tr>");
+				for (std::size_t j = this->random(1, 8); j > 0; --j) {
+					this->emit("<td>" + this->text(1));
+				}
+			}
+			this->emit("</table>\n");
+			break;
+		case 2:
+			this->emit("<dl>");
+			for (std::size_t i = 0; i < count; ++i) {
+				this->emit("<dt>" + this->text(1) + "<dd>"
+					+ this->text(this->random(2, 6)));
+			}
+			this->emit("</dl>\n");
+			break;
+		default:
+			// Paragraph is closed implicitly by the end of its parent.
+			for (std::size_t i = 0; i < count; ++i) {
+				this->emit("<div><p>" + this->text(this->random(3, 12))
+					+ "</div>");
+			}
+			this->emit("\n");
+			break;
+		}
+	}
+
+	void
+	entity_dense()
+	{
+		std::string paragraph = "<p>";
+		std::size_t count = this->random(16, 64);
+		for (std::size_t i = 0; i < count; ++i) {
+			paragraph += this->pick(entities);
+			if (this->random(3) == 0) {
+				paragraph += this->pick(words);
+			}
+		}
+		paragraph += "</p>\n";
+		this->emit(paragraph);
+	}
+};
+
+} // namespace.
+
+
+generator_options
+default_generator_options(document_shape shape, std::size_t size,
+	std::uint32_t seed)
+{
+	return generator_options{shape, size, seed, 512, 10000};
+}
+
+
+void
+generate_html(const generator_options& options, std::ostream& out)
+{
+	html_generator generator(options, out);
+	generator.run();
+}
+
+
+std::string
+generate_html(const generator_options& options)
+{
+	std::ostringstream out;
+	generate_html(options, out);
+	return out.str();
+}
+
+
+const char*
+shape_name(document_shape shape)
+{
+	switch (shape) {
+	case document_shape::mixed:
+		return "mixed";
+	case document_shape::deep_nesting:
+		return "deep_nesting";
+	case document_shape::wide_siblings:
+		return "wide_siblings";
+	case document_shape::attribute_heavy:
+		return "attribute_heavy";
+	case document_shape::raw_text:
+		return "raw_text";
+	case document_shape::implied_end_tags:
+		return "implied_end_tags";
+	case document_shape::entity_dense:
+		return "entity_dense";
+	}
+
+	return "";
+}
+
+
+document_shape
+shape_from_name(const std::string& name)
+{
+	for (auto shape : all_shapes()) {
+		if (name == shape_name(shape)) {
+			return shape;
+		}
+	}
+
+	throw std::invalid_argument("Unknown document shape: " + name);
+}
+
+
+std::vector<document_shape>
+all_shapes()
+{
+	return {document_shape::mixed, document_shape::deep_nesting,
+		document_shape::wide_siblings, document_shape::attribute_heavy,
+		document_shape::raw_text, document_shape::implied_end_tags,
+		document_shape::entity_dense};
+}
+
+
+std::size_t
+parse_size(const std::string& size)
+{
+	std::size_t digits_end = 0;
+	std::size_t value = 0;
+	try {
+		value = std::stoull(size, &digits_end);
+	}
+	catch (const std::exception&) {
+		throw std::invalid_argument("Invalid size: " + size);
+	}
+
+	std::string suffix = size.substr(digits_end);
+	std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
+	if (suffix == "k" || suffix == "kb") {
+		value *= 1024;
+	}
+	else if (suffix == "m" || suffix == "mb") {
+		value *= 1024 * 1024;
+	}
+	else if (suffix == "g" || suffix == "gb") {
+		value *= 1024 * 1024 * 1024;
+	}
+	else if (!suffix.empty()) {
+		throw std::invalid_argument("Invalid size: " + size);
+	}
+
+	return value;
+}
+
+} // bench.
+
+} // cpphtml.
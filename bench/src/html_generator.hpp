@@ -0,0 +1,103 @@
+#ifndef CPPHTML_BENCH_HTML_GENERATOR_HPP
+#define CPPHTML_BENCH_HTML_GENERATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+namespace cpphtml
+{
+
+namespace bench
+{
+
+/**
+ * Shape of the synthetic HTML document.
+ */
+enum class document_shape {
+	/** All of the shapes below interleaved. */
+	mixed,
+	/** Elements nested max_depth levels deep. */
+	deep_nesting,
+	/** Parents with max_width children each. */
+	wide_siblings,
+	/** Elements with dozens of attributes quoted in various ways. */
+	attribute_heavy,
+	/** Large script and style blocks with markup-like content. */
+	raw_text,
+	/** Lists, tables and paragraphs without end tags. */
+	implied_end_tags,
+	/** Text full of named and numeric character references. */
+	entity_dense,
+};
+
+
+struct generator_options {
+	document_shape shape;
+	/** Approximate size of the generated document in bytes. */
+	std::size_t size;
+	/** Same seed and options produce the same document. */
+	std::uint32_t seed;
+	/**
+	 * Maximum element nesting. Kept bounded, because node tree is
+	 * destroyed recursively.
+	 */
+	std::size_t max_depth;
+	/** Maximum number of children per parent in wide_siblings shape. */
+	std::size_t max_width;
+};
+
+
+/**
+ * @return options with the defaults for the specified shape and size.
+ */
+generator_options default_generator_options(document_shape shape,
+	std::size_t size, std::uint32_t seed = 1);
+
+
+/**
+ * Writes generated document to the stream in chunks, so documents larger
+ * than the available memory could be generated.
+ */
+void generate_html(const generator_options& options, std::ostream& out);
+
+
+/**
+ * @return generated document.
+ */
+std::string generate_html(const generator_options& options);
+
+
+/**
+ * @return shape name, e.g. "deep_nesting".
+ */
+const char* shape_name(document_shape shape);
+
+
+/**
+ * @throws std::invalid_argument if name does not denote any shape.
+ */
+document_shape shape_from_name(const std::string& name);
+
+
+/**
+ * @return all available shapes.
+ */
+std::vector<document_shape> all_shapes();
+
+
+/**
+ * Parses size with optional suffix: k, m or g, e.g. "64k" or "1g".
+ *
+ * @throws std::invalid_argument if size is malformed.
+ */
+std::size_t parse_size(const std::string& size);
+
+} // bench.
+
+} // cpphtml.
+
+#endif /* CPPHTML_BENCH_HTML_GENERATOR_HPP */
@@ -0,0 +1,155 @@
+/**
+ * libFuzzer target for cpp-html parser, which also detects superlinear
+ * complexity. Every input is parsed and queried once as is and once
+ * repeated scale_factor times. Input is reported as a crash if parse time
+ * per byte of the repeated input grows superlinear_ratio times or more.
+ *
+ * Parse time per byte of the slowest input seen so far is printed, when it
+ * increases.
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include <cpp-html/document.hpp>
+#include <cpp-html/node.hpp>
+#include <cpp-html/parser.hpp>
+
+
+namespace
+{
+
+typedef std::chrono::steady_clock fuzz_clock;
+
+// Input is repeated this many times to check how parse time scales.
+const std::size_t scale_factor = 8;
+
+// Time per byte growth which is reported as superlinear. It's linear, when
+// the growth is about 1, and quadratic, when it's about scale_factor.
+const double superlinear_ratio = 4.0;
+
+// Repeated inputs parsed faster are not checked, because timing of them
+// is too noisy.
+const double min_checked_time = 1e-3;
+
+// Times are measured this many times and the minimum is taken.
+const int timing_runs = 3;
+
+double slowest_time_per_byte = 0;
+
+
+/**
+ * Calls DOM queries which walk up the tree or along the siblings.
+ */
+class query_walker : public cpphtml::node_walker {
+public:
+	bool
+	for_each(std::shared_ptr<cpphtml::node> node) override
+	{
+		if (node->type() == cpphtml::node_element) {
+			node->previous_sibling(node->name());
+		}
+
+		if (this->depth() >= this->max_depth_) {
+			this->max_depth_ = this->depth();
+			this->deepest_node_ = node;
+		}
+
+		return true;
+	}
+
+	bool
+	end(std::shared_ptr<cpphtml::node>) override
+	{
+		if (this->deepest_node_) {
+			this->deepest_node_->path();
+		}
+
+		return true;
+	}
+
+private:
+	int max_depth_ = 0;
+	std::shared_ptr<cpphtml::node> deepest_node_;
+};
+
+
+void
+parse_and_query(const std::string& html)
+{
+	cpphtml::parser parser(cpphtml::parser::parse_full);
+	std::shared_ptr<cpphtml::document> doc;
+	try {
+		doc = parser.parse(html);
+	}
+	catch (const cpphtml::parse_error&) {
+		doc = parser.get_document();
+	}
+
+	query_walker walker;
+	doc->traverse(walker);
+}
+
+
+/**
+ * @return minimum wall time of parse_and_query() in seconds.
+ */
+double
+measure(const std::string& html)
+{
+	double min_time = std::numeric_limits<double>::max();
+	for (int i = 0; i < timing_runs; ++i) {
+		auto start = fuzz_clock::now();
+		parse_and_query(html);
+		double time = std::chrono::duration<double>(fuzz_clock::now()
+			- start).count();
+		min_time = std::min(min_time, time);
+	}
+
+	return min_time;
+}
+
+} // namespace.
+
+
+extern "C" int
+LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+	if (size == 0) {
+		return 0;
+	}
+
+	std::string html(reinterpret_cast<const char*>(data), size);
+	double time = measure(html);
+
+	std::string scaled_html;
+	scaled_html.reserve(html.size() * scale_factor);
+	for (std::size_t i = 0; i < scale_factor; ++i) {
+		scaled_html += html;
+	}
+	double scaled_time = measure(scaled_html);
+
+	double time_per_byte = scaled_time / scaled_html.size();
+	if (time_per_byte > slowest_time_per_byte) {
+		slowest_time_per_byte = time_per_byte;
+		std::fprintf(stderr, "Slowest input: %.2f ns/byte, %zu bytes.\n",
+			time_per_byte * 1e9, scaled_html.size());
+	}
+
+	double growth = time_per_byte / (time / html.size());
+	if (scaled_time >= min_checked_time && growth >= superlinear_ratio) {
+		std::fprintf(stderr, "Superlinear parse time: %zu bytes parsed "
+			"in %.3f ms, repeated %zu times in %.3f ms. Time per byte "
+			"grows %.1f times.\n", html.size(), time * 1e3,
+			scale_factor, scaled_time * 1e3, growth);
+		std::abort();
+	}
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+/**
+ * Runs fuzz target on the specified files and directories, when compiler
+ * does not support libFuzzer. It's used to replay the seed corpus and
+ * crashing inputs.
+ *
+ * Usage: cpp-html-fuzz file_or_directory...
+ */
+
+#include <dirent.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data,
+	std::size_t size);
+
+
+namespace
+{
+
+/**
+ * Lists files in directory, or returns the path itself, if it's not a
+ * directory.
+ */
+std::vector<std::string>
+list_files(const std::string& path)
+{
+	std::vector<std::string> files;
+
+	DIR* dir = opendir(path.c_str());
+	if (dir == nullptr) {
+		files.push_back(path);
+		return files;
+	}
+
+	while (dirent* entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if (name != "." && name != "..") {
+			files.push_back(path + "/" + name);
+		}
+	}
+	closedir(dir);
+
+	return files;
+}
+
+} // namespace.
+
+
+int
+main(int argc, char* argv[])
+{
+	std::size_t input_count = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		for (auto& file_name : list_files(argv[i])) {
+			std::ifstream file(file_name, std::ios::binary);
+			if (!file) {
+				std::cerr << "Failed to open " << file_name
+					<< std::endl;
+				return 1;
+			}
+
+			std::string input((std::istreambuf_iterator<char>(file)),
+				std::istreambuf_iterator<char>());
+			LLVMFuzzerTestOneInput(reinterpret_cast<const std::uint8_t*>(
+				input.data()), input.size());
+			++input_count;
+		}
+	}
+
+	std::cerr << "Executed " << input_count << " inputs." << std::endl;
+	return 0;
+}
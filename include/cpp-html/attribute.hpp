@@ -4,22 +4,28 @@
 #include <memory>
 
 #include <cpp-html/cpp-html.hpp>
-#include <cpp-html/node.hpp>
 
 
 namespace cpphtml
 {
 
 /**
- * Class for manipulating attributes in DOM tree.
+ * Class for manipulating attributes in DOM tree. Element attributes are
+ * stored by value inside the element node, see node::first_attribute().
  */
-class attribute : public node {
+class attribute {
 public:
 	/**
 	 * Constructs attribute with default value "".
 	 */
-	static std::shared_ptr<attribute> create(const string_type& name,
-		const string_type& value = "");
+	explicit attribute(string_type name, string_type value = "");
+
+	/**
+	 * Constructs standalone attribute with default value "", which might
+	 * be copied into element with node::append_attribute().
+	 */
+	static std::shared_ptr<attribute> create(string_type name,
+		string_type value = "");
 
 	/**
 	 * Compares attribute name/value pairs.
@@ -35,26 +41,45 @@ public:
 	 * Set attribute value.
 	 */
 	attribute& operator=(const string_type& attr_val);
+	attribute& operator=(string_type&& attr_val);
+
+	/**
+	 * @return attribute name or "" if attribute is empty. Like other
+	 *	accessors, returns reference to the string stored in attribute.
+	 */
+	const string_type& name() const;
+
+	/**
+	 * @return attribute name spelled as in parsed html document, e.g. "id"
+	 *	for attribute named "ID".
+	 */
+	const string_type& source_name() const;
 
 	/**
-	 * @return attribute name or "" if attribute is empty.
+	 * Sets attribute name spelling used in html document. It must differ
+	 * from attribute name only in letter case.
 	 */
-	string_type name() const;
+	void source_name(const string_type& source_name);
+	void source_name(string_type&& source_name);
 
 	/**
 	 * @return attribute value or "" if attribute is empty.
 	 */
-	string_type value() const;
+	const string_type& value() const;
 
 	/**
 	 * Sets attribute value.
 	 */
 	void value(const string_type& attr_val);
+	void value(string_type&& attr_val);
 
 private:
-	attribute(const string_type& name, const string_type& value);
+	friend class document;
+	friend class node;
 
 	string_type name_;
+	// Set only if name is spelled differently in parsed html.
+	string_type source_name_;
 	string_type value_;
 };
 
@@ -0,0 +1,71 @@
+#ifndef CPPHTML_BATCH_HPP
+#define CPPHTML_BATCH_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <cpp-html/cpp-html.hpp>
+#include <cpp-html/document.hpp>
+#include <cpp-html/parser.hpp>
+
+
+namespace cpphtml
+{
+
+/**
+ * Result of a single html document parsing in a batch.
+ */
+struct parse_result {
+	// Parsed document. When parsing fails, it's the document built so far.
+	std::shared_ptr<document> doc;
+
+	parse_status status;
+};
+
+
+/**
+ * Callback receiving parse results as soon as documents are parsed.
+ * It's called concurrently from worker threads.
+ *
+ * @param index index of parsed html in the input list.
+ */
+typedef std::function<void (std::size_t index, const parse_result& result)>
+	batch_callback;
+
+
+/**
+ * Parses html documents in parallel on a work-stealing thread pool.
+ * Each worker thread reuses a single copy of the specified parser for all
+ * its documents, so parser options, elements filter, stop condition and
+ * limits apply to every document. Statistics are not collected: the
+ * stats object set with parser::collect_stats() is left untouched.
+ *
+ * Only parser scratch buffers are reused between documents. Every document
+ * is allocated anew, because it's handed over to the caller, so there's no
+ * memory arena reuse.
+ *
+ * @param inputs html documents to parse.
+ * @param callback receives each parse result.
+ * @param thread_count worker thread count. 0 means the number of hardware
+ *	threads.
+ * @param prototype parser configured for parsing the documents.
+ * @throws exception thrown by the callback after all workers stop.
+ */
+void parse_batch(const std::vector<string_type>& inputs,
+	batch_callback callback, std::size_t thread_count = 0,
+	const parser& prototype = parser());
+
+
+/**
+ * Parses html documents in parallel on a work-stealing thread pool.
+ *
+ * @return parse results in input order.
+ */
+std::vector<parse_result> parse_batch(const std::vector<string_type>& inputs,
+	std::size_t thread_count = 0, const parser& prototype = parser());
+
+} // cpphtml.
+
+#endif // CPPHTML_BATCH_HPP
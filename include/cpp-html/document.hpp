@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <memory>
+#include <cstddef>
 
 #include <cpp-html/cpp-html.hpp>
 #include <cpp-html/node.hpp>
@@ -11,6 +12,42 @@
 namespace cpphtml
 {
 
+/**
+ * Approximate heap memory used by document tree, see
+ * document::memory_usage(). Allocator overhead is not included.
+ */
+struct document_memory_usage {
+	static const std::size_t node_type_count = node_doctype + 1;
+
+	// Node objects with their shared_ptr control blocks, indexed by
+	// node_type. Attributes are counted as node_attribute, but take no
+	// node bytes, because they are stored in their element's attribute
+	// array.
+	std::size_t node_count[node_type_count];
+	std::size_t node_bytes[node_type_count];
+
+	// Heap storage of node and attribute strings, indexed by node_type.
+	// Strings short enough for the small string buffer use no heap.
+	// Lazily parsed attributes are counted with their element.
+	std::size_t string_bytes[node_type_count];
+
+	// List nodes of children lists and heap allocated attribute arrays.
+	std::size_t container_bytes;
+
+	document_memory_usage();
+
+	/**
+	 * @return node count of all types.
+	 */
+	std::size_t total_node_count() const;
+
+	/**
+	 * @return bytes used by the whole tree.
+	 */
+	std::size_t total_bytes() const;
+};
+
+
 /**
  * Document class (DOM tree root).
  */
@@ -39,6 +76,12 @@ public:
 	std::vector<std::shared_ptr<node> > get_elements_by_tag_name(
 		const string_type& tag_name) const;
 
+	/**
+	 * Walks the whole tree and estimates memory used by the document,
+	 * its nodes and attributes.
+	 */
+	document_memory_usage memory_usage() const;
+
 private:
 	/**
 	 * Builds an empty document. It's html node with type node_document.
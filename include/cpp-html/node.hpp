@@ -2,14 +2,17 @@
 #define PUGIHTML_NODE_HPP 1
 
 #include <list>
+#include <vector>
 #include <algorithm>
 #include <iterator>
 #include <memory>
 #include <functional>
 #include <cstddef>
+#include <utility>
 
 #include <cpp-html/cpp-html.hpp>
 #include <cpp-html/config.hpp>
+#include <cpp-html/attribute.hpp>
 
 
 namespace cpphtml
@@ -31,7 +34,10 @@ enum node_type {
 
 
 class node_walker;
-class attribute;
+class node_ref;
+class attribute_ref;
+class document;
+class parser;
 
 /**
  * An HTML document tree node.
@@ -44,10 +50,10 @@ public:
 	typedef std::list<std::shared_ptr<node> >::iterator iterator;
 
 	/**
-	 * Node attribute interator type.
+	 * Node attribute interator type. Attributes are stored contiguously,
+	 * so adding or removing attributes invalidates attribute iterators.
 	 */
-	typedef std::list<std::shared_ptr<attribute> >::iterator
-		attribute_iterator;
+	typedef attribute* attribute_iterator;
 
 
 	/**
@@ -55,31 +61,54 @@ public:
 	 */
 	static std::shared_ptr<node> create(node_type type = node_pcdata);
 
+	/**
+	 * Detaches child nodes, which outlive this node.
+	 */
+	~node();
+
 	/**
 	 * @return node type.
 	 */
 	node_type type() const;
 
 	/**
-	 * @return node name. E.g. HTML or BODY, etc.
+	 * @return node name. E.g. HTML or BODY, etc. Returned reference is
+	 *	valid until the name is changed or the node is destroyed.
 	 */
-	string_type name() const;
+	const string_type& name() const;
 
 	/**
 	 * Sets node tag name. Node name is optional. E.g. pcdata nodes
-	 * do not have a name.
+	 * do not have a name. Source name spelling is reset to the new name.
 	 */
 	void name(const string_type& name);
+	void name(string_type&& name);
 
 	/**
-	 * @return text inside node.
+	 * @return node name spelled as in parsed html document, e.g. "div"
+	 *	for node named "DIV". It's the same as name() for nodes created
+	 *	not by parser.
 	 */
-	string_type value() const;
+	const string_type& source_name() const;
+
+	/**
+	 * Sets node name spelling used in html document. It must differ
+	 * from node name only in letter case.
+	 */
+	void source_name(const string_type& source_name);
+	void source_name(string_type&& source_name);
+
+	/**
+	 * @return text inside node. Returned reference is valid until the
+	 *	value is changed or the node is destroyed.
+	 */
+	const string_type& value() const;
 
 	/**
 	 * Change text node value.
 	 */
 	void value(const string_type& value);
+	void value(string_type&& value);
 
 	/**
 	 * @return the textual content of the specified node, and all its
@@ -89,43 +118,57 @@ public:
 
 
 	// Attribute related methods.
+	//
+	// Attributes are stored inside the node. Returned attribute_ref
+	// handles are like iterators: they are invalidated when attributes
+	// of the node are added or removed.
 
 	/**
-	 * Returns pointer to the first attribute or nullptr, if node has
+	 * Returns handle to the first attribute or empty handle, if node has
 	 * no attributes.
 	 */
-	std::shared_ptr<attribute> first_attribute() const;
+	attribute_ref first_attribute() const;
 
 	/**
-	 * Returns pointer to the first attribute or nullptr, if node has
+	 * Returns handle to the last attribute or empty handle, if node has
 	 * no attributes.
 	 */
-	std::shared_ptr<attribute> last_attribute() const;
+	attribute_ref last_attribute() const;
 
 	/**
-	 * @return pointer to the attribute with the specified name or nullptr,
-	 *	if such attribute does not exist.
+	 * @return handle to the attribute with the specified name or empty
+	 *	handle, if such attribute does not exist.
 	 */
-	std::shared_ptr<attribute> get_attribute(const string_type& name) const;
+	attribute_ref get_attribute(const string_type& name) const;
 
 	/**
 	 * Appends new attribute with the specified name to the end of attribute
 	 * list.
 	 *
+	 * Arguments are taken by value, so rvalue strings are moved into
+	 * the attribute without copying.
+	 *
 	 * @param name new attribute name.
 	 * @param value new attribute value.
-	 * @return pointer to newly added attribute.
+	 * @return handle to newly added attribute.
+	 */
+	attribute_ref append_attribute(string_type name,
+		string_type value = "");
+
+	/**
+	 * Appends copy of the attribute to the end of attribute list.
+	 *
+	 * @return handle to newly added attribute.
 	 */
-	std::shared_ptr<attribute> append_attribute(const string_type& name,
-		const string_type& value = "");
+	attribute_ref append_attribute(std::shared_ptr<attribute> attr);
+	attribute_ref append_attribute(const attribute_ref& attr);
 
 	/**
-	 * Appends new attribute to the end of attribute list.
+	 * Moves the attribute to the end of attribute list.
 	 *
-	 * @return pointer to newly added attribute.
+	 * @return handle to newly added attribute.
 	 */
-	std::shared_ptr<attribute> append_attribute(
-		std::shared_ptr<attribute> attr);
+	attribute_ref append_attribute(attribute&& attr);
 
 	/**
 	 * Prepends new attribute with the specified name to the beginning of
@@ -133,18 +176,25 @@ public:
 	 *
 	 * @param name new attribute name.
 	 * @param value new attribute value.
-	 * @return pointer to newly added attribute.
+	 * @return handle to newly added attribute.
 	 */
-	std::shared_ptr<attribute> prepend_attribute(const string_type& name,
-		const string_type& value = "");
+	attribute_ref prepend_attribute(string_type name,
+		string_type value = "");
 
 	/**
-	 * Prepends new attribute to the beginning of attribute list.
+	 * Prepends copy of the attribute to the beginning of attribute list.
 	 *
-	 * @return pointer to newly added attribute.
+	 * @return handle to newly added attribute.
 	 */
-	std::shared_ptr<attribute> prepend_attribute(
-		std::shared_ptr<attribute> attr);
+	attribute_ref prepend_attribute(std::shared_ptr<attribute> attr);
+	attribute_ref prepend_attribute(const attribute_ref& attr);
+
+	/**
+	 * Moves the attribute to the beginning of attribute list.
+	 *
+	 * @return handle to newly added attribute.
+	 */
+	attribute_ref prepend_attribute(attribute&& attr);
 
 	/**
 	 * Remove specified attribute if it exists.
@@ -156,16 +206,11 @@ public:
 
 	/**
 	 * Find attribute using predicate. Returns first attribute for which
-	 * predicate returned true.
+	 * predicate returned true. Predicate takes const attribute& or
+	 * std::shared_ptr<attribute>, which keeps the node alive.
 	 */
-	template <typename Predicate> std::shared_ptr<attribute>
-	find_attribute(Predicate pred) const
-	{
-		auto it_attr = std::find_if(std::begin(this->attributes_),
-			std::end(this->attributes_), pred);
-		return it_attr == std::end(this->attributes_) ? nullptr
-			: *it_attr;
-	}
+	template <typename Predicate> attribute_ref
+	find_attribute(Predicate pred) const;
 
 
 	// Child nodes related methods.
@@ -192,8 +237,8 @@ public:
 	std::shared_ptr<node> next_sibling() const;
 
 	/**
-	 * @return next sibling node with the specified name or nullptr, if
-	 *	such node does not exist.
+	 * @return the nearest next sibling node with the specified name or
+	 *	nullptr, if such node does not exist.
 	 */
 	std::shared_ptr<node> next_sibling(const string_type& name) const;
 
@@ -203,8 +248,10 @@ public:
 	std::shared_ptr<node> previous_sibling() const;
 
 	/**
-	 * @return previous sibling node with the specified name or nullptr, if
-	 *	such node does not exist.
+	 * @return the nearest previous sibling node with the specified name or
+	 *	nullptr, if such node does not exist. Like next_sibling(name),
+	 *	it stops at the first match, so it takes time linear in the
+	 *	distance to it.
 	 */
 	std::shared_ptr<node> previous_sibling(const string_type& name) const;
 
@@ -214,10 +261,23 @@ public:
 	std::shared_ptr<node> parent() const;
 
 	/**
-	 * @return root of DOM tree this node belongs to.
+	 * @return root of DOM tree this node belongs to. It's found in
+	 *	constant time for nodes inside a document.
 	 */
 	std::shared_ptr<node> root() const;
 
+	/**
+	 * @return document this node belongs to or nullptr, if node is not
+	 *	inserted into a document tree. Document node belongs to itself.
+	 */
+	std::shared_ptr<document> owner_document() const;
+
+	/**
+	 * @return non-owning reference to this node, which navigates the tree
+	 *	without reference counting.
+	 */
+	node_ref ref() const;
+
 	/**
 	 * Returns empty string, if no PCDATA/CDATA child nodes are found.
 	 *
@@ -231,17 +291,74 @@ public:
 	string_type child_value(const string_type& name) const;
 
 	/**
-	 * Append new child node.
+	 * Append new child node. Inserting a node which already has a parent
+	 * moves it: the node is spliced out of the old parent child list in
+	 * constant time. When the node changes document, owner document of
+	 * its whole subtree is updated, which takes time linear in subtree
+	 * size. The same holds for prepend_child(), insert_before(),
+	 * insert_after() and move_to().
+	 *
+	 * Node which has children is checked not to be an ancestor of this
+	 * node. The check walks up from this node, so it takes time linear in
+	 * tree depth.
+	 *
+	 * @throws std::invalid_argument if node is this node or its ancestor.
 	 */
 	void append_child(std::shared_ptr<node> _node);
 
+	/**
+	 * Creates node of the specified type and appends it to the end of
+	 * child list.
+	 *
+	 * @return newly added node.
+	 */
+	std::shared_ptr<node> append_child(node_type type);
+
 	/**
 	 * Prepend new child node.
+	 *
+	 * @throws std::invalid_argument if node is this node or its ancestor.
 	 */
 	void prepend_child(std::shared_ptr<node> _node);
 
 	/**
-	 * Remove child node with the specified name.
+	 * Inserts new child node before the reference child.
+	 *
+	 * @throws std::invalid_argument if ref_child is not a child of this
+	 *	node or new_child is this node or its ancestor.
+	 */
+	void insert_before(std::shared_ptr<node> new_child,
+		const std::shared_ptr<node>& ref_child);
+
+	/**
+	 * Inserts new child node after the reference child.
+	 *
+	 * @throws std::invalid_argument if ref_child is not a child of this
+	 *	node or new_child is this node or its ancestor.
+	 */
+	void insert_after(std::shared_ptr<node> new_child,
+		const std::shared_ptr<node>& ref_child);
+
+	/**
+	 * Detaches this node from its parent. Unlinking takes constant time,
+	 * but if the node belonged to a document, owner document of its
+	 * subtree is cleared, which takes time linear in subtree size.
+	 *
+	 * @return false if node has no parent.
+	 */
+	bool remove();
+
+	/**
+	 * Moves this node with its subtree to the end of child list of the
+	 * new parent.
+	 *
+	 * @throws std::invalid_argument if new parent is this node or its
+	 *	descendant.
+	 */
+	void move_to(const std::shared_ptr<node>& new_parent);
+
+	/**
+	 * Remove the first child node with the specified name.
 	 *
 	 * @return true on success, false if such node was not found.
 	 */
@@ -269,37 +386,7 @@ public:
 	 * subtree (depth-first), for which predicate returned true.
 	 */
 	template <typename Predicate> std::shared_ptr<node>
-	find_node(Predicate pred) const
-	{
-		std::shared_ptr<node> child = this->first_child();
-		int traverse_depth = 1;
-		while (traverse_depth > 0) {
-			if (pred(child)) {
-				return child;
-			}
-
-			if (child->first_child()) {
-				child = child->first_child();
-				++traverse_depth;
-			}
-			else if (child->next_sibling()) {
-				child = child->next_sibling();
-			}
-			else {
-				while (!child->next_sibling() &&
-					traverse_depth > 0) {
-					child = child->parent();
-					--traverse_depth;
-				}
-
-				if (traverse_depth > 0) {
-					child = child->next_sibling();
-				}
-			}
-		}
-
-		return std::shared_ptr<node>(nullptr);
-	}
+	find_node(Predicate pred) const;
 
 	/**
 	 * Finds all nodes satisfying the specified predicate.
@@ -393,20 +480,333 @@ protected:
 	node(node_type type = node_pcdata);
 
 private:
-	std::weak_ptr<node> parent_;
+	// Measures memory usage of the tree.
+	friend class document;
+	// Sets raw attributes, when parsing attributes lazily.
+	friend class parser;
+	friend class node_ref;
+	friend class attribute_ref;
+
+	// Parent owns its children, so the pointer is not owning. It's cleared
+	// when the node is removed from the parent or the parent is destroyed.
+	node* parent_;
+	// Document node of the tree. Set for the whole subtree when it's
+	// inserted into a document and cleared when it's removed.
+	node* document_;
 	// Iterator in parent child nodes. Used for next_sibling(),
 	// prev_sibling().
 	iterator parent_it_;
 
 	string_type name_;
+	// Set only if name is spelled differently in parsed html.
+	string_type source_name_;
 	string_type value_;
 	node_type type_;
 
 	std::list<std::shared_ptr<node> > children_;
-	std::list<std::shared_ptr<attribute> > attributes_;
+	// Attributes of an element are kept in one array instead of being
+	// allocated one by one. Mutable, because attributes are materialized
+	// on first access.
+	mutable std::vector<attribute> attributes_;
+	// Start tag markup between element name and '>', which is not parsed
+	// into attributes yet. See parser::parse_lazy_attributes.
+	mutable string_type raw_attributes_;
+
+	/**
+	 * Parses raw attributes, if there are any. It's not synchronized, see
+	 * parser::parse_lazy_attributes.
+	 */
+	void materialize_attributes() const;
+
+	/**
+	 * Appends attribute without making a handle to it.
+	 *
+	 * @return reference to the new attribute, valid until attributes are
+	 *	added or removed.
+	 */
+	attribute& add_attribute(string_type name, string_type value);
+
+	/**
+	 * @return handle to attribute stored in this node.
+	 */
+	attribute_ref attribute_handle(const attribute& attr) const;
+
+	/**
+	 * @return attribute with the specified name or nullptr.
+	 */
+	const attribute* find_attribute_by_name(const string_type& name) const;
+
+	/**
+	 * Calls predicate taking const attribute&.
+	 */
+	template <typename Predicate> auto
+	test_attribute(Predicate& pred, std::size_t index, int) const
+		-> decltype(bool(pred(std::declval<const attribute&>())))
+	{
+		return pred(this->attributes_[index]);
+	}
+
+	/**
+	 * Calls predicate taking std::shared_ptr<attribute>.
+	 */
+	template <typename Predicate> bool
+	test_attribute(Predicate& pred, std::size_t index, long) const
+	{
+		return pred(std::shared_ptr<attribute>(
+			std::const_pointer_cast<node>(this->shared_from_this()),
+			&this->attributes_[index]));
+	}
+
+	/**
+	 * Links child to this node before the specified position in child
+	 * list, unlinking it from its current parent.
+	 *
+	 * @throws std::invalid_argument if child is this node or its
+	 *	ancestor.
+	 */
+	void link_child(iterator pos, std::shared_ptr<node> child);
+
+	/**
+	 * Sets document of this node and its subtree.
+	 */
+	void set_owner_document(node* doc);
+
+	/**
+	 * Detaches child nodes and moves them to orphans.
+	 */
+	void release_children(std::vector<std::shared_ptr<node> >& orphans);
+};
+
+
+/**
+ * Non-owning reference to a DOM tree node. Navigating the tree with it only
+ * follows pointers and does not touch shared_ptr reference counts. It is
+ * valid while the node stays in the tree and the tree is alive.
+ */
+class node_ref {
+public:
+	node_ref(const node* ref_node = nullptr) : node_(ref_node)
+	{
+	}
+
+	const node* get() const { return this->node_; }
+	const node& operator*() const { return *this->node_; }
+	const node* operator->() const { return this->node_; }
+	explicit operator bool() const { return this->node_ != nullptr; }
+
+	bool
+	operator==(const node_ref& other) const
+	{
+		return this->node_ == other.node_;
+	}
+
+	bool
+	operator!=(const node_ref& other) const
+	{
+		return this->node_ != other.node_;
+	}
+
+	node_ref
+	first_child() const
+	{
+		return this->node_->children_.empty() ? nullptr
+			: this->node_->children_.front().get();
+	}
+
+	node_ref
+	last_child() const
+	{
+		return this->node_->children_.empty() ? nullptr
+			: this->node_->children_.back().get();
+	}
+
+	node_ref
+	next_sibling() const
+	{
+		const node* parent = this->node_->parent_;
+		if (!parent) {
+			return nullptr;
+		}
+
+		auto it_next = std::next(this->node_->parent_it_);
+		return it_next != std::end(parent->children_) ? it_next->get()
+			: nullptr;
+	}
+
+	node_ref
+	previous_sibling() const
+	{
+		const node* parent = this->node_->parent_;
+		return parent && this->node_->parent_it_
+			!= std::begin(parent->children_)
+			? std::prev(this->node_->parent_it_)->get() : nullptr;
+	}
+
+	node_ref parent() const { return this->node_->parent_; }
+
+	/**
+	 * @return root of DOM tree this node belongs to or empty reference,
+	 *	if node has no parent. Same as node::root().
+	 */
+	node_ref
+	root() const
+	{
+		if (this->node_->document_ && this->node_->document_
+			!= this->node_) {
+			return this->node_->document_;
+		}
+
+		const node* result = this->node_->parent_;
+		while (result && result->parent_) {
+			result = result->parent_;
+		}
+
+		return result;
+	}
+
+	/**
+	 * @return next node of the subtree in depth-first order or empty
+	 *	reference after the last node of the subtree.
+	 */
+	node_ref
+	next(node_ref subtree_root) const
+	{
+		node_ref result = this->first_child();
+		if (result) {
+			return result;
+		}
+
+		for (node_ref curr = *this; curr && curr != subtree_root;
+			curr = curr.parent()) {
+			result = curr.next_sibling();
+			if (result) {
+				return result;
+			}
+		}
+
+		return nullptr;
+	}
+
+	/**
+	 * @return pointer sharing ownership of the node.
+	 */
+	std::shared_ptr<node>
+	lock() const
+	{
+		return this->node_ ? std::const_pointer_cast<node>(
+			this->node_->shared_from_this()) : nullptr;
+	}
+
+private:
+	const node* node_;
+};
+
+
+inline node_ref
+node::ref() const
+{
+	return node_ref(this);
+}
+
+
+template <typename Predicate> std::shared_ptr<node>
+node::find_node(Predicate pred) const
+{
+	// Only nodes passed to the predicate are reference counted.
+	for (node_ref curr = this->ref().first_child(); curr;
+		curr = curr.next(this)) {
+		auto curr_node = curr.lock();
+		if (pred(curr_node)) {
+			return curr_node;
+		}
+	}
+
+	return nullptr;
+}
+
+
+/**
+ * Handle to an attribute stored inside an element node: the node and the
+ * attribute position. Like an iterator, it's invalidated when attributes of
+ * the node are added or removed and when the node is destroyed.
+ */
+class attribute_ref {
+public:
+	attribute_ref(std::nullptr_t = nullptr) : owner_(nullptr), index_(0)
+	{
+	}
+
+	/**
+	 * @return pointer to the attribute or nullptr, if handle is empty.
+	 */
+	attribute* get() const;
+
+	/**
+	 * @throw std::out_of_range if handle is empty.
+	 */
+	attribute& operator*() const;
+	attribute* operator->() const { return &**this; }
+	explicit operator bool() const { return this->get() != nullptr; }
+
+	/**
+	 * @return node the attribute belongs to or nullptr, if handle is
+	 *	empty.
+	 */
+	std::shared_ptr<node> owner() const;
+
+private:
+	friend class node;
+
+	attribute_ref(const node* owner, std::size_t index)
+		: owner_(const_cast<node*>(owner)), index_(index)
+	{
+	}
+
+	node* owner_;
+	std::size_t index_;
 };
 
 
+inline attribute*
+attribute_ref::get() const
+{
+	return this->owner_ && this->index_ < this->owner_->attributes_.size()
+		? &this->owner_->attributes_[this->index_] : nullptr;
+}
+
+
+/**
+ * Handles are equal if they refer to the same attribute. Empty handles are
+ * equal to nullptr.
+ */
+inline bool
+operator==(const attribute_ref& lhs, const attribute_ref& rhs)
+{
+	return lhs.get() == rhs.get();
+}
+
+
+inline bool
+operator!=(const attribute_ref& lhs, const attribute_ref& rhs)
+{
+	return !(lhs == rhs);
+}
+
+
+template <typename Predicate> attribute_ref
+node::find_attribute(Predicate pred) const
+{
+	this->materialize_attributes();
+	for (std::size_t i = 0; i < this->attributes_.size(); ++i) {
+		if (this->test_attribute(pred, i, 0)) {
+			return attribute_ref(this, i);
+		}
+	}
+
+	return nullptr;
+}
+
+
 /**
  * Abstract DOM tree node walker class (see node::traverse)
  */
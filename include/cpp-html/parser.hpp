@@ -3,6 +3,11 @@
 
 #include <stdexcept>
 #include <memory>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <set>
+#include <vector>
 
 #include <cpp-html/cpp-html.hpp>
 #include <cpp-html/document.hpp>
@@ -51,10 +56,104 @@ enum parse_status {
 	status_bad_start_element,   // Parsing error occurred while parsing start element tag
 	status_bad_attribute,       // Parsing error occurred while parsing element attribute
 	status_bad_end_element,     // Parsing error occurred while parsing end element tag
-	status_end_element_mismatch // There was a mismatch of start-end tags (closing tag had incorrect name, some tag was not closed or there was an excessive closing tag)
+	status_end_element_mismatch, // There was a mismatch of start-end tags (closing tag had incorrect name, some tag was not closed or there was an excessive closing tag)
+
+	status_stopped,             // Parsing was stopped by the stop condition before the end of document
+
+	status_input_too_large,           // Input is larger than parse_limits::max_input_size
+	status_depth_limit_exceeded,      // Elements are nested deeper than parse_limits::max_depth
+	status_node_limit_exceeded,       // Document has more nodes than parse_limits::max_nodes
+	status_attribute_limit_exceeded,  // Element has more attributes than parse_limits::max_attributes
+	status_text_limit_exceeded        // Text, comment or attribute value is longer than parse_limits::max_text_length
+};
+
+
+/**
+ * Parser resource limits. Zero means there's no limit.
+ * When a limit is exceeded parser throws parse_error with the corresponding
+ * parse_status. Nodes built so far are left in the parsed document.
+ */
+struct parse_limits {
+	// Maximum html string length in characters.
+	std::size_t max_input_size = 0;
+
+	// Maximum element nesting depth. Document children are at depth 1.
+	std::size_t max_depth = 0;
+
+	// Maximum number of nodes created by a single parse() call.
+	std::size_t max_nodes = 0;
+
+	// Maximum number of attributes per element.
+	std::size_t max_attributes = 0;
+
+	// Maximum length of a single text node, comment or attribute value.
+	std::size_t max_text_length = 0;
 };
 
 
+/**
+ * Statistics collected by parse() when enabled with parser::collect_stats().
+ * They are reset at the start of every parse() call.
+ */
+struct parse_stats {
+	// Html characters scanned. Less than input size, if parsing stopped.
+	std::size_t bytes_scanned = 0;
+
+	// Created DOM nodes and attributes. Text nodes include raw text and
+	// CDATA sections. Lazily parsed attributes are not counted.
+	std::size_t elements = 0;
+	std::size_t text_nodes = 0;
+	std::size_t attributes = 0;
+
+	// Elements closed without end tag: by the next sibling start tag,
+	// e.g. <li> after <li>, or by the end tag of their parent.
+	std::size_t implied_end_tags = 0;
+
+	// Void and self-closing elements, e.g. <br>, <img/>.
+	std::size_t void_elements = 0;
+
+	// Content of raw text and RCDATA elements, e.g. SCRIPT, TITLE.
+	std::size_t raw_text_bytes = 0;
+
+	// Maximum element nesting depth. Document children are at depth 1.
+	std::size_t max_depth = 0;
+
+	// Estimated heap allocations of created nodes, attributes and their
+	// strings. Strings short enough for the small string buffer are not
+	// counted.
+	std::size_t allocations = 0;
+	std::size_t allocated_bytes = 0;
+
+	// Wall time of the whole parse() call and of its phases. Tag time
+	// includes attributes, comments and doctype.
+	std::chrono::nanoseconds total_time{0};
+	std::chrono::nanoseconds tag_time{0};
+	std::chrono::nanoseconds text_time{0};
+	std::chrono::nanoseconds raw_text_time{0};
+};
+
+
+/**
+ * Parsing events passed to the parse stop condition.
+ */
+enum parse_event {
+	// Start tag with its attributes was parsed. Raw text elements, e.g.
+	// SCRIPT or TITLE, already have their text parsed.
+	event_start_tag,
+
+	// Element was closed by its end tag.
+	event_end_tag
+};
+
+
+/**
+ * Condition checked by parser after each parsing event. Parsing is stopped
+ * as soon as it returns true.
+ */
+typedef std::function<bool (parse_event, const std::shared_ptr<node>&)>
+	parse_stop_condition;
+
+
 /**
  * HTML parser.
  *
@@ -105,7 +204,6 @@ public:
 	 * consist only of whitespace are added to the DOM tree.
 	 * This flag is off by default; turning it on usually results in slower
 	 * parsing and more memory consumption.
-	 * NOTE: currently this option is disabled.
 	 */
 	static const unsigned int parse_ws_pcdata = 0x0008;
 
@@ -145,6 +243,23 @@ public:
 	 */
 	static const unsigned int parse_doctype = 0x0200;
 
+	/**
+	 * This flag determines if element attributes are parsed lazily:
+	 * parser only copies the raw start tag markup after element name,
+	 * which is parsed into attributes on the first attribute access.
+	 * Parsing is faster and uses less memory, when most attributes are
+	 * never read. Malformed attributes are then skipped instead of
+	 * failing parse() and attribute limits are not checked, so the flag
+	 * is ignored when max_attributes or max_text_length limit is set.
+	 *
+	 * Attribute access, including const methods like get_attribute()
+	 * and to_string(), then modifies the element. So a lazily parsed
+	 * document is not safe to read from several threads at once, unless
+	 * attributes of all elements are accessed by one thread first.
+	 * This flag is off by default.
+	 */
+	static const unsigned int parse_lazy_attributes = 0x0400;
+
 	/**
 	 * The default parsing mode.
 	 * Elements, PCDATA and CDATA sections are added to the DOM tree,
@@ -199,11 +314,31 @@ public:
 	static const char_type* advance_doctype_group(const char_type* s,
 		char_type endch, bool top_level = true);
 
+	/**
+	 * Parses start tag markup following element name, e.g.
+	 * ' id="main" hidden', and appends the attributes to the element.
+	 * Attribute names are capitalized. Malformed attributes are skipped.
+	 * Used to materialize lazily parsed attributes.
+	 */
+	static void parse_attributes(const string_type& raw_attributes,
+		node& element);
+
 	/**
 	 * Creates new parser with the specified parsing options.
 	 */
 	parser(unsigned int options = parse_default);
 
+	/**
+	 * Prepares parser for the next html document: subsequent parse()
+	 * builds a new document instead of appending nodes to the previous
+	 * one. Previously returned documents stay valid.
+	 *
+	 * Parsing options, elements filter, stop condition, limits and
+	 * internal scratch buffers with their capacity are kept, so the same
+	 * parser can be used for many documents.
+	 */
+	void reset();
+
 	/**
 	 * Parse node contents, starting with exclamation mark.
 	 *
@@ -225,6 +360,60 @@ public:
 	 */
 	std::shared_ptr<document> parse(const string_type& str_html);
 
+	/**
+	 * Parses large html document on multiple threads. Html is split at
+	 * tag boundaries found by a quick pre-scan, the chunks are parsed
+	 * into separate trees in parallel and then stitched together
+	 * sequentially, resolving the elements left open by the previous
+	 * chunks.
+	 *
+	 * Small documents, as well as parsers with elements filter, stop
+	 * condition or limits other than max_input_size set, are parsed
+	 * with parse(). Each chunk is copied, so peak memory usage is
+	 * higher than with parse().
+	 *
+	 * @param thread_count maximum thread count. 0 means the number of
+	 *	hardware threads.
+	 */
+	std::shared_ptr<document> parse_parallel(const string_type& str_html,
+		std::size_t thread_count = 0);
+
+	/**
+	 * Parses html document with html scanning running on a separate
+	 * thread. Scanned markup is passed in batches of events to the tree
+	 * builder running on the calling thread, so long documents use two
+	 * cores.
+	 *
+	 * Builds the same DOM tree as parse(). Parsers with elements filter,
+	 * stop condition or statistics set use parse().
+	 */
+	std::shared_ptr<document> parse_pipelined(const string_type& str_html);
+
+	/**
+	 * Makes parse() fill the specified statistics. Null pointer disables
+	 * statistics, which is the default. Parser does not own the stats
+	 * object, it must outlive parse() calls.
+	 *
+	 * parse_parallel() and parse_pipelined() use parse() while statistics
+	 * are collected.
+	 */
+	void collect_stats(parse_stats* stats);
+
+	/**
+	 * Sets parser resource limits.
+	 */
+	void limits(const parse_limits& limits);
+
+	/**
+	 * @return parser resource limits.
+	 */
+	const parse_limits& limits() const;
+
+	/**
+	 * @return last parse status.
+	 */
+	parse_status status() const;
+
 	/**
 	 * @return last parse status description.
 	 */
@@ -240,19 +429,114 @@ public:
 	 */
 	std::shared_ptr<document> get_document() const;
 
+	/**
+	 * Sets condition on which parsing is stopped. parse() then returns
+	 * the document built so far and parser status is set to
+	 * status_stopped. Empty function disables the stop condition.
+	 */
+	void stop_when(parse_stop_condition condition);
+
+	/**
+	 * Makes parser stop right after the end tag of the specified element,
+	 * e.g. HEAD.
+	 */
+	void stop_after_end_tag(const string_type& tag_name);
+
+	/**
+	 * Makes parser skip the specified elements together with their
+	 * subtrees. Skipped subtrees are scanned over without creating any
+	 * nodes, only elements nesting inside them is tracked.
+	 * Empty set disables elements filter.
+	 *
+	 * @param tag_names element names, e.g. SCRIPT, STYLE, SVG.
+	 */
+	void skip_elements(const std::set<string_type>& tag_names);
+
+	/**
+	 * Makes parser build only the subtrees of the specified elements.
+	 * Outermost kept elements are appended to the document, everything
+	 * outside of them is scanned over without creating any nodes.
+	 * An end tag of element which was not built closes the kept subtree
+	 * it's found in.
+	 *
+	 * @param tag_names element names, e.g. HEAD, A.
+	 */
+	void keep_elements(const std::set<string_type>& tag_names);
+
 private:
+	enum filter_mode {
+		filter_none,
+		filter_skip,
+		filter_keep
+	};
+
 	unsigned int options_;
 	parse_status status_ = status_ok;
 
+	parse_stop_condition stop_condition_;
+
+	parse_limits limits_;
+	// Statistics of the current parse() call or null.
+	parse_stats* stats_ = nullptr;
+	// Nodes created by the current parse() call.
+	std::size_t node_count_ = 0;
+	// Depth of the current node.
+	std::size_t depth_ = 0;
+
+	// Flag indicating that html fragment is parsed: end tags of elements
+	// opened before the fragment are kept in DOM tree as node_null nodes.
+	bool fragment_ = false;
+
+	filter_mode filter_mode_ = filter_none;
+	// Upper case names of elements to skip or keep.
+	std::set<string_type> filter_elements_;
+	// Names of elements open inside the currently skipped element.
+	std::vector<string_type> skipped_elements_;
+	// Scratch buffers reused while parsing.
+	string_type tag_name_buffer_;
+	string_type attribute_name_buffer_;
+	string_type name_buffer_;
+
 	char_type* error_offset_ = nullptr;
 
 	std::shared_ptr<document> document_;
 	std::shared_ptr<node> current_node_;
 
+	class tree_builder;
+
+	/**
+	 * Scans html and reports the markup it finds to the builder:
+	 * tree_builder or a builder passing the markup to it from another
+	 * thread.
+	 */
+	template <typename Builder> void scan(const string_type& str_html,
+		Builder& builder);
+
+	/**
+	 * Scans markup starting with exclamation mark, see
+	 * parse_exclamation().
+	 */
+	template <typename Builder> const char_type* scan_exclamation(
+		const char_type* s, char_type endch, Builder& builder);
+
 	/**
 	 * Checks if the specified parsing option is set.
 	 */
 	bool option_set(unsigned int opt);
+
+	void set_filter_elements(const std::set<string_type>& tag_names);
+
+	/**
+	 * Throws parse_error, if value exceeds the specified limit. Parser
+	 * status is set from the error by parse methods.
+	 */
+	void check_limit(std::size_t value, std::size_t limit,
+		parse_status status);
+
+	/**
+	 * Counts new node and checks node count limit.
+	 */
+	void count_node();
 };
 
 
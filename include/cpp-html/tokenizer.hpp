@@ -1,8 +1,12 @@
 #ifndef CPPHTML_TOKENIZER_HPP
 #define CPPHTML_TOKENIZER_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <cpp-html/cpp-html.hpp>
 
@@ -23,15 +27,88 @@ enum class token_type {
 };
 
 
+// Tokenizer states as defined by WHATWG html living standard.
 enum class tokenizer_state {
 	data,
+	rcdata,
+	rawtext,
+	script_data,
+	plaintext,
 	tag_open,
 	end_tag_open,
 	tag_name,
+	rcdata_less_than_sign,
+	rcdata_end_tag_open,
+	rcdata_end_tag_name,
+	rawtext_less_than_sign,
+	rawtext_end_tag_open,
+	rawtext_end_tag_name,
+	script_data_less_than_sign,
+	script_data_end_tag_open,
+	script_data_end_tag_name,
+	script_data_escape_start,
+	script_data_escape_start_dash,
+	script_data_escaped,
+	script_data_escaped_dash,
+	script_data_escaped_dash_dash,
+	script_data_escaped_less_than_sign,
+	script_data_escaped_end_tag_open,
+	script_data_escaped_end_tag_name,
+	script_data_double_escape_start,
+	script_data_double_escaped,
+	script_data_double_escaped_dash,
+	script_data_double_escaped_dash_dash,
+	script_data_double_escaped_less_than_sign,
+	script_data_double_escape_end,
 	before_attribute_name,
 	attribute_name,
+	after_attribute_name,
 	before_attribute_value,
-	unquoted_attribute_value
+	attribute_value_double_quoted,
+	attribute_value_single_quoted,
+	unquoted_attribute_value,
+	after_attribute_value_quoted,
+	self_closing_start_tag,
+	bogus_comment,
+	markup_declaration_open,
+	comment_start,
+	comment_start_dash,
+	comment,
+	comment_less_than_sign,
+	comment_less_than_sign_bang,
+	comment_less_than_sign_bang_dash,
+	comment_less_than_sign_bang_dash_dash,
+	comment_end_dash,
+	comment_end,
+	comment_end_bang,
+	doctype,
+	before_doctype_name,
+	doctype_name,
+	after_doctype_name,
+	after_doctype_public_keyword,
+	before_doctype_public_identifier,
+	doctype_public_identifier_double_quoted,
+	doctype_public_identifier_single_quoted,
+	after_doctype_public_identifier,
+	between_doctype_public_and_system_identifiers,
+	after_doctype_system_keyword,
+	before_doctype_system_identifier,
+	doctype_system_identifier_double_quoted,
+	doctype_system_identifier_single_quoted,
+	after_doctype_system_identifier,
+	bogus_doctype,
+	cdata_section,
+	cdata_section_bracket,
+	cdata_section_end,
+	character_reference,
+	named_character_reference,
+	ambiguous_ampersand,
+	numeric_character_reference,
+	hexadecimal_character_reference_start,
+	decimal_character_reference_start,
+	hexadecimal_character_reference,
+	decimal_character_reference,
+	numeric_character_reference_end
 };
 
 
@@ -40,24 +117,62 @@ typedef std::unordered_map<std::string, std::string> attribute_list_type;
 
 struct token {
 	token_type type;
+	// Tag name, text, comment text or doctype name.
 	string_type value;
 
 	bool has_attributes;
 	attribute_list_type attributes;
+
+	// Start tag ends with "/>".
+	bool self_closing;
+
+	string_type public_identifier;
+	string_type system_identifier;
+	// Doctype is malformed, document should be rendered in quirks mode.
+	bool force_quirks;
 };
 
 
+/**
+ * Html tokenizer implementing WHATWG tokenization algorithm. Adjacent
+ * characters are emitted as a single string token, character references are
+ * decoded to UTF-8 and tag and attribute names are lower case.
+ *
+ * Token buffers are reused, so iterating allocates only when a token is
+ * longer than any previous one.
+ */
 class token_iterator {
 public:
 	typedef std::string::const_iterator const_char_iterator;
 
 
+	/**
+	 * Tokenizes html document. Tokenizer switches to RCDATA, RAWTEXT,
+	 * script data or PLAINTEXT state after the start tag of the
+	 * corresponding element like the tree construction stage does.
+	 */
 	token_iterator(const std::string& html);
 
+	/**
+	 * Tokenizes html starting in the specified state. Tokenizer never
+	 * switches states on its own after start tags, which is the setup
+	 * html5lib tokenizer tests expect.
+	 *
+	 * @param last_start_tag name of the last start tag emitted before
+	 *	html, used to match end tags in RCDATA, RAWTEXT and script data.
+	 */
+	token_iterator(const std::string& html, tokenizer_state initial_state,
+		const string_type& last_start_tag = "");
+
+	token& operator*();
+
 	token* operator->();
 
 	token_iterator& operator++();
 
+	/**
+	 * @return false if iterator points to end_of_file token.
+	 */
 	bool has_next() const;
 
 	token next();
@@ -65,38 +180,226 @@ public:
 private:
 	// TODO(povilas): change string to string_type.
 	const std::string html_;
-	const_char_iterator it_html_;
+	const char_type* s_;
+	const char_type* end_;
+
+	// Token iterator points to.
 	token current_token_;
+	// Tag, comment or doctype token being built.
+	token tag_token_;
+	// tag_token_ is complete and is emitted after the current token.
+	bool tag_token_pending_ = false;
+	bool eof_ = false;
+	// Characters not emitted yet.
+	string_type text_;
+
 	tokenizer_state state_;
+	tokenizer_state return_state_ = tokenizer_state::data;
+	bool switch_to_raw_text_;
+
+	bool in_attribute_ = false;
+	string_type attribute_name_;
+	string_type attribute_value_;
+	string_type last_start_tag_;
+	string_type temporary_buffer_;
+	unsigned long char_ref_code_ = 0;
+
+
+	/**
+	 * Makes the next token current.
+	 */
+	void advance();
+
+	/**
+	 * Runs tokenizer state machine until token is emitted.
+	 */
+	void run_state_machine();
+
+	/**
+	 * Handles end of file in the current state.
+	 */
+	void on_eof();
+
+	void create_tag_token(token_type type);
+
+	void start_attribute();
+
+	void finish_attribute();
+
+	/**
+	 * Emits tag, comment or doctype token. Pending characters are emitted
+	 * first.
+	 */
+	void emit_tag_token();
+
+	bool is_appropriate_end_tag() const;
+
+	/**
+	 * Handles end tag name character in RCDATA, RAWTEXT and script data
+	 * states.
+	 *
+	 * @return true if token was emitted.
+	 */
+	bool on_raw_text_end_tag_name(char_type ch, tokenizer_state text_state);
+
+	bool in_attribute_value() const;
+
+	/**
+	 * Appends characters consumed as character reference to attribute
+	 * value or text.
+	 */
+	void flush_char_ref(const string_type& chars);
+
+	void on_named_char_ref();
+
+	void on_numeric_char_ref_end();
+};
 
-	string_type curr_attribute_name_;
-	string_type curr_attribute_value_;
 
+/**
+ * Bitmaps of structural characters in a block of 64 html characters. Bit i
+ * stands for the character i of the block.
+ */
+struct structural_block {
+	// <, >, ", ', =, & and the first character of every white space run.
+	std::uint64_t structural;
+	// Only '<' and '>', so text and comments are skipped a block at a
+	// time.
+	std::uint64_t tag_open;
+	std::uint64_t tag_close;
+};
+
+
+/**
+ * Marks positions of structural characters. When SSE2 is available, 16
+ * characters are classified at once.
+ *
+ * @param blocks receives one block for every 64 html characters, so the
+ *	index takes 3 bits per character.
+ */
+void index_structural_chars(const char_type* html, std::size_t size,
+	std::vector<structural_block>& blocks);
+
+
+/**
+ * Characters of html, which token refers to instead of copying them.
+ */
+struct token_span {
+	const char_type* begin;
+	const char_type* end;
+
+	std::size_t size() const { return this->end - this->begin; }
+	bool empty() const { return this->begin == this->end; }
+	string_type str() const { return string_type(this->begin, this->end); }
+};
+
+
+/**
+ * Token of indexed_token_iterator. It refers to html characters, so it's
+ * valid until the iterator is advanced.
+ */
+struct indexed_token {
+	token_type type;
+	// Tag name, text, comment text or doctype name as spelled in html.
+	token_span value;
+	// Attribute names and values in document order. Attribute without
+	// value has an empty one.
+	std::vector<std::pair<token_span, token_span> > attributes;
+};
+
+
+/**
+ * Two-stage tokenizer for scanning workloads. The constructor makes a single
+ * vectorized pass over html building structural character bitmaps, which
+ * take 3 bits per html character. Tokens are then built by walking the
+ * bitmaps 64 characters at a time, so text and attribute values are not
+ * scanned again. Character references are not decoded.
+ *
+ * Emits start_tag, end_tag, string, comment, doctype and end_of_file tokens.
+ * Raw text element (script, style, etc.) content is a single string token.
+ * Tokens refer to html instead of copying it, so tokenizing doesn't allocate
+ * once the attribute list has grown. Html must outlive the iterator.
+ */
+class indexed_token_iterator {
+public:
+	indexed_token_iterator(const string_type& html);
+
+	indexed_token& operator*();
+
+	indexed_token* operator->();
+
+	indexed_token_iterator& operator++();
+
+	/**
+	 * @return false if iterator points to end_of_file token.
+	 */
+	bool has_next() const;
+
+	/**
+	 * @return html structural character bitmaps, see
+	 *	index_structural_chars().
+	 */
+	const std::vector<structural_block>& structural_index() const;
+
+private:
+	const string_type& html_;
+	std::vector<structural_block> blocks_;
+	// Position of the first not tokenized character.
+	std::size_t pos_ = 0;
+	indexed_token current_token_;
+	// Lower case name of raw text element whose content is tokenized next
+	// or nullptr.
+	const string_type* raw_text_element_ = nullptr;
+
+
+	void next();
+
+	/**
+	 * @return position of the first structural character at or after
+	 *	the specified position or html size if there is none.
+	 */
+	std::size_t next_structural(std::size_t from) const;
+
+	/**
+	 * @return position of the first specified structural character at or
+	 *	after the specified position or html size if there is none.
+	 */
+	std::size_t next_structural(std::size_t from, char_type ch) const;
 
-	bool on_data_state();
-	bool on_tag_open_state();
-	bool on_end_tag_open_state();
-	bool on_tag_name_state();
-	bool on_before_attribute_name_state();
-	bool on_attribute_name_state();
-	bool on_before_attribute_value_state();
-	bool on_unquoted_attribute_value_state();
-	token scan_string_token();
+	/**
+	 * @return position of the first bit set in the specified bitmap of
+	 *	structural blocks at or after the specified position or html
+	 *	size if there is none.
+	 */
+	std::size_t next_bit(std::size_t from,
+		std::uint64_t structural_block::* bitmap) const;
 
 	/**
-	 * @return true if EOF reached while scanning.
+	 * Scans tag starting at pos_ up to '>'.
+	 *
+	 * @param type start_tag or end_tag.
 	 */
-	bool is_eof() const;
+	void scan_tag(token_type type);
 
 	/**
-	 * Creates new current token if current character is ASCII letter.
-	 * Sets new scanner state.
+	 * Scans comment or doctype starting at pos_.
+	 */
+	void scan_markup_declaration();
+
+	/**
+	 * Scans raw text element content up to its end tag.
 	 *
-	 * @param type new token type.
-	 * @param new_state new tokenizer state.
+	 * @return true if content is not empty and the token was created.
+	 */
+	bool scan_raw_text();
+
+	void set_current_token(token_type type, std::size_t start,
+		std::size_t end);
+
+	/**
+	 * @return span of html characters in range [start, end).
 	 */
-	void create_tag_token_if_curr_char_is_letter(token_type type,
-		tokenizer_state new_state);
+	token_span span(std::size_t start, std::size_t end) const;
 };
 
 
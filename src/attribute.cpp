@@ -1,4 +1,5 @@
 #include <memory>
+#include <utility>
 
 #include <cpp-html/attribute.hpp>
 #include <cpp-html/cpp-html.hpp>
@@ -8,16 +9,16 @@ namespace cpphtml
 {
 
 
-attribute::attribute(const string_type& name, const string_type& value)
-	: node(node_attribute), name_(name), value_(value)
+attribute::attribute(string_type name, string_type value)
+	: name_(std::move(name)), value_(std::move(value))
 {
 }
 
 
 std::shared_ptr<attribute>
-attribute::create(const string_type& name, const string_type& value)
+attribute::create(string_type name, string_type value)
 {
-	return std::shared_ptr<attribute>(new attribute(name, value));
+	return std::make_shared<attribute>(std::move(name), std::move(value));
 }
 
 
@@ -43,14 +44,48 @@ attribute::operator=(const string_type& attr_val)
 }
 
 
-string_type
+attribute&
+attribute::operator=(string_type&& attr_val)
+{
+	this->value_ = std::move(attr_val);
+	return *this;
+}
+
+
+const string_type&
 attribute::name() const
 {
 	return this->name_;
 }
 
 
-string_type
+const string_type&
+attribute::source_name() const
+{
+	return this->source_name_.empty() ? this->name_ : this->source_name_;
+}
+
+
+void
+attribute::source_name(const string_type& source_name)
+{
+	this->source_name_ = source_name != this->name_ ? source_name : "";
+}
+
+
+void
+attribute::source_name(string_type&& source_name)
+{
+	if (source_name != this->name_) {
+		this->source_name_ = std::move(source_name);
+	}
+	else {
+		this->source_name_.clear();
+	}
+}
+
+
+const string_type&
 attribute::value() const
 {
 	return this->value_;
@@ -63,4 +98,11 @@ attribute::value(const string_type& attr_val)
 	this->value_ = attr_val;
 }
 
+
+void
+attribute::value(string_type&& attr_val)
+{
+	this->value_ = std::move(attr_val);
+}
+
 } //cpp-html.
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include <cpp-html/batch.hpp>
+
+
+namespace cpphtml
+{
+
+/**
+ * Queue of input indices owned by a single worker. The owner takes work from
+ * the front, other workers steal from the back.
+ */
+class work_queue {
+public:
+	void
+	push(std::size_t index)
+	{
+		this->indices_.push_back(index);
+	}
+
+	bool
+	pop(std::size_t& index)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		if (this->indices_.empty()) {
+			return false;
+		}
+
+		index = this->indices_.front();
+		this->indices_.pop_front();
+		return true;
+	}
+
+	bool
+	steal(std::size_t& index)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		if (this->indices_.empty()) {
+			return false;
+		}
+
+		index = this->indices_.back();
+		this->indices_.pop_back();
+		return true;
+	}
+
+private:
+	std::mutex mutex_;
+	std::deque<std::size_t> indices_;
+};
+
+
+inline parse_result
+parse_document(parser& html_parser, const string_type& html)
+{
+	html_parser.reset();
+
+	parse_status status = status_ok;
+	try {
+		html_parser.parse(html);
+		status = html_parser.status();
+	}
+	catch (const parse_error& e) {
+		status = e.status();
+	}
+	catch (const std::bad_alloc&) {
+		status = status_out_of_memory;
+	}
+
+	return parse_result{html_parser.get_document(), status};
+}
+
+
+void
+parse_batch(const std::vector<string_type>& inputs, batch_callback callback,
+	std::size_t thread_count, const parser& prototype)
+{
+	if (inputs.empty()) {
+		return;
+	}
+
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	thread_count = std::min(thread_count, inputs.size());
+
+	// Each worker starts with a contiguous block of inputs.
+	std::vector<work_queue> queues(thread_count);
+	for (std::size_t i = 0; i < inputs.size(); ++i) {
+		queues[i * thread_count / inputs.size()].push(i);
+	}
+
+	std::mutex error_mutex;
+	std::exception_ptr error;
+
+	auto worker = [&](std::size_t worker_id) {
+		parser html_parser(prototype);
+		// Statistics object of the prototype would be shared by all
+		// workers.
+		html_parser.collect_stats(nullptr);
+
+		std::size_t index = 0;
+		while (true) {
+			bool found = queues[worker_id].pop(index);
+			for (std::size_t i = 1; !found && i < thread_count; ++i) {
+				found = queues[(worker_id + i) % thread_count]
+					.steal(index);
+			}
+
+			if (!found) {
+				break;
+			}
+
+			try {
+				callback(index, parse_document(html_parser,
+					inputs[index]));
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (std::size_t i = 1; i < thread_count; ++i) {
+		threads.emplace_back(worker, i);
+	}
+	worker(0);
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+
+std::vector<parse_result>
+parse_batch(const std::vector<string_type>& inputs, std::size_t thread_count,
+	const parser& prototype)
+{
+	std::vector<parse_result> results(inputs.size());
+
+	parse_batch(inputs, [&](std::size_t index, const parse_result& result) {
+		results[index] = result;
+	}, thread_count, prototype);
+
+	return results;
+}
+
+} // cpphtml.
@@ -1,5 +1,6 @@
 #include <vector>
 #include <memory>
+#include <algorithm>
 
 #include <cpp-html/document.hpp>
 #include <cpp-html/node.hpp>
@@ -9,47 +10,96 @@
 namespace cpphtml
 {
 
+namespace
+{
 
-std::shared_ptr<document>
-document::create()
+// Estimated size of shared_ptr control block: virtual table pointer,
+// reference counters and the owned pointer.
+const std::size_t control_block_size = 3 * sizeof(void*);
+
+
+/**
+ * @return heap bytes used by string or 0, if it fits into the small string
+ *	buffer.
+ */
+std::size_t
+string_heap_bytes(const string_type& str)
 {
-	return std::shared_ptr<document>(new document());
+	static const std::size_t small_string_capacity = string_type()
+		.capacity();
+
+	return str.capacity() > small_string_capacity
+		? (str.capacity() + 1) * sizeof(char_type) : 0;
 }
 
 
-document::document() : node(node_document)
+/**
+ * @return size of std::list node holding element of the specified type.
+ */
+template <typename T> constexpr std::size_t
+list_node_size()
 {
+	return 2 * sizeof(void*) + sizeof(T);
 }
 
+} // namespace.
+
 
-class links_walker : public node_walker {
-public:
-	links_walker(std::vector<std::shared_ptr<node> >& links) : links_(links)
-	{
+document_memory_usage::document_memory_usage() : container_bytes(0)
+{
+	std::fill(std::begin(this->node_count), std::end(this->node_count), 0);
+	std::fill(std::begin(this->node_bytes), std::end(this->node_bytes), 0);
+	std::fill(std::begin(this->string_bytes),
+		std::end(this->string_bytes), 0);
+}
+
+
+std::size_t
+document_memory_usage::total_node_count() const
+{
+	std::size_t count = 0;
+	for (auto node_count : this->node_count) {
+		count += node_count;
 	}
 
-	bool
-	for_each(std::shared_ptr<node> node) override
-	{
-		if (node->name() == "A" ||
-			node->name() == "AREA") {
-			this->links_.push_back(node);
-		}
+	return count;
+}
 
-		return true;
+
+std::size_t
+document_memory_usage::total_bytes() const
+{
+	std::size_t bytes = this->container_bytes;
+	for (std::size_t i = 0; i < node_type_count; ++i) {
+		bytes += this->node_bytes[i] + this->string_bytes[i];
 	}
 
-private:
-	std::vector<std::shared_ptr<node> >& links_;
-};
+	return bytes;
+}
+
+
+std::shared_ptr<document>
+document::create()
+{
+	return std::shared_ptr<document>(new document());
+}
+
+
+document::document() : node(node_document)
+{
+}
+
 
 std::vector<std::shared_ptr<node> >
 document::links() const
 {
 	std::vector<std::shared_ptr<node> > result;
-
-	links_walker html_walker(result);
-	const_cast<document*>(this)->traverse(html_walker);
+	for (node_ref curr = this->ref().first_child(); curr;
+		curr = curr.next(this)) {
+		if (curr->name() == "A" || curr->name() == "AREA") {
+			result.push_back(curr.lock());
+		}
+	}
 
 	return result;
 }
@@ -58,43 +108,77 @@ document::links() const
 std::shared_ptr<node>
 document::get_element_by_id(const string_type& id) const
 {
-	return this->find_node([&](const std::shared_ptr<node>& node) {
-		auto attr = node->get_attribute("ID");
-		return attr ? attr->value() == id : false;
-	});
+	// Nodes are visited by reference and their attributes are looked up
+	// without making attribute handles, so nothing is reference counted
+	// until the element is found.
+	const string_type id_name = "ID";
+	for (node_ref curr = this->ref().first_child(); curr;
+		curr = curr.next(this)) {
+		const attribute* attr = curr->find_attribute_by_name(id_name);
+		if (attr && attr->value() == id) {
+			return curr.lock();
+		}
+	}
+
+	return nullptr;
 }
 
 
-class tags_walker : public node_walker {
-public:
-	std::vector<std::shared_ptr<node> > tag_elements;
+std::vector<std::shared_ptr<node> >
+document::get_elements_by_tag_name(const string_type& tag_name) const
+{
+	std::vector<std::shared_ptr<node> > result;
+	for (node_ref curr = this->ref().first_child(); curr;
+		curr = curr.next(this)) {
+		if (curr->name() == tag_name) {
+			result.push_back(curr.lock());
+		}
+	}
 
+	return result;
+}
 
-	tags_walker(const string_type& tag_name) : tag_name_(tag_name)
-	{
-	}
 
-	bool
-	for_each(std::shared_ptr<node> node) override
-	{
-		if (node->name() == this->tag_name_) {
-			this->tag_elements.push_back(node);
+document_memory_usage
+document::memory_usage() const
+{
+	document_memory_usage usage;
+
+	// Tree is walked iteratively, so that deep trees would not overflow
+	// the stack.
+	std::vector<const node*> nodes = {this};
+	while (!nodes.empty()) {
+		const node* curr_node = nodes.back();
+		nodes.pop_back();
+
+		node_type type = curr_node->type_;
+		++usage.node_count[type];
+		usage.node_bytes[type] += (curr_node == this ? sizeof(document)
+			: sizeof(node)) + control_block_size;
+		usage.string_bytes[type] += string_heap_bytes(curr_node->name_)
+			+ string_heap_bytes(curr_node->source_name_)
+			+ string_heap_bytes(curr_node->value_)
+			+ string_heap_bytes(curr_node->raw_attributes_);
+
+		usage.container_bytes += curr_node->children_.size()
+			* list_node_size<std::shared_ptr<node> >();
+
+		auto& attributes = curr_node->attributes_;
+		usage.container_bytes += attributes.capacity()
+			* sizeof(attribute);
+		for (auto& attr : attributes) {
+			++usage.node_count[node_attribute];
+			usage.string_bytes[node_attribute] += string_heap_bytes(
+				attr.name_) + string_heap_bytes(attr.source_name_)
+				+ string_heap_bytes(attr.value_);
 		}
 
-		return true;
+		for (auto& child : curr_node->children_) {
+			nodes.push_back(child.get());
+		}
 	}
 
-private:
-	const string_type tag_name_;
-};
-
-std::vector<std::shared_ptr<node> >
-document::get_elements_by_tag_name(const string_type& tag_name) const
-{
-	tags_walker html_walker(tag_name);
-	const_cast<document*>(this)->traverse(html_walker);
-
-	return html_walker.tag_elements;
+	return usage;
 }
 
 } // cpp-html.
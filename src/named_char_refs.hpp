@@ -0,0 +1,27 @@
+#ifndef CPPHTML_NAMED_CHAR_REFS_HPP
+#define CPPHTML_NAMED_CHAR_REFS_HPP
+
+#include <cstddef>
+
+#include <cpp-html/cpp-html.hpp>
+
+
+namespace cpphtml
+{
+
+// Longest named character reference name without the terminating ';'.
+const std::size_t max_char_ref_name_size = 31;
+
+
+/**
+ * Looks up named character reference in the full WHATWG list.
+ *
+ * @param name reference name after '&', including ';' if it's terminated.
+ * @return UTF-8 encoded characters the reference stands for or nullptr,
+ *	if there's no such reference.
+ */
+const char* find_named_char_ref(const char_type* name, std::size_t size);
+
+} // cpphtml.
+
+#endif // CPPHTML_NAMED_CHAR_REFS_HPP
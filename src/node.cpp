@@ -5,9 +5,12 @@
 #include <sstream>
 #include <stdexcept>
 #include <functional>
+#include <vector>
 
 #include <cpp-html/node.hpp>
 #include <cpp-html/attribute.hpp>
+#include <cpp-html/document.hpp>
+#include <cpp-html/parser.hpp>
 
 
 namespace cpphtml
@@ -35,11 +38,54 @@ allow_insert_child(node_type parent, node_type child)
 }
 
 
-node::node(node_type type) : type_(type)
+node::node(node_type type) : parent_(nullptr),
+	document_(type == node_document ? this : nullptr), type_(type)
 {
 }
 
 
+node::~node()
+{
+	if (this->children_.empty()) {
+		return;
+	}
+
+	// Subtree is released iteratively: children of a node, which is about
+	// to be destroyed, are moved to the work list first. So no destructor
+	// recurses and deep trees don't overflow the stack.
+	std::vector<std::shared_ptr<node> > orphans;
+	this->release_children(orphans);
+	while (!orphans.empty()) {
+		std::shared_ptr<node> curr = std::move(orphans.back());
+		orphans.pop_back();
+
+		// Child outlives this node only if it's referenced elsewhere.
+		if (curr.use_count() > 1) {
+			curr->set_owner_document(nullptr);
+		}
+		else {
+			curr->release_children(orphans);
+		}
+	}
+}
+
+
+void
+node::release_children(std::vector<std::shared_ptr<node> >& orphans)
+{
+	for (auto& child : this->children_) {
+		// Child might be appended to another node already.
+		if (child->parent_ != this) {
+			continue;
+		}
+
+		child->parent_ = nullptr;
+		orphans.push_back(std::move(child));
+	}
+	this->children_.clear();
+}
+
+
 std::shared_ptr<node>
 node::create(node_type type)
 {
@@ -54,7 +100,7 @@ node::type() const
 }
 
 
-string_type
+const string_type&
 node::name() const
 {
 	return this->name_;
@@ -65,33 +111,87 @@ void
 node::name(const string_type& name)
 {
 	this->name_ = name;
+	this->source_name_.clear();
 }
 
 
-string_type
+void
+node::name(string_type&& name)
+{
+	this->name_ = std::move(name);
+	this->source_name_.clear();
+}
+
+
+const string_type&
+node::source_name() const
+{
+	return this->source_name_.empty() ? this->name_ : this->source_name_;
+}
+
+
+void
+node::source_name(const string_type& source_name)
+{
+	this->source_name_ = source_name != this->name_ ? source_name : "";
+}
+
+
+void
+node::source_name(string_type&& source_name)
+{
+	if (source_name != this->name_) {
+		this->source_name_ = std::move(source_name);
+	}
+	else {
+		this->source_name_.clear();
+	}
+}
+
+
+const string_type&
 node::value() const
 {
 	return this->value_;
 }
 
 
-void
-node::value(const string_type& value)
+/**
+ * @return true if nodes of the specified type hold text value.
+ */
+inline bool
+node_type_has_value(node_type type)
 {
-	switch (type())
+	switch (type)
 	{
 	case node_pi:
 	case node_cdata:
 	case node_pcdata:
 	case node_comment:
 	case node_doctype:
-		this->value_ = value;
-		break;
+		return true;
 
 	default:
-		return;
+		return false;
+	}
+}
+
+
+void
+node::value(const string_type& value)
+{
+	if (node_type_has_value(this->type_)) {
+		this->value_ = value;
 	}
+}
+
 
+void
+node::value(string_type&& value)
+{
+	if (node_type_has_value(this->type_)) {
+		this->value_ = std::move(value);
+	}
 }
 
 
@@ -103,88 +203,121 @@ node::text_content() const
 	}
 
 	std::string text;
-	auto tree_walker = make_node_walker([&](std::shared_ptr<node> node,
-		std::size_t) {
-
-		text += node->value();
-		return true;
-	});
-	(const_cast<node*>(this))->traverse(*tree_walker);
+	for (node_ref curr = this->ref().first_child(); curr;
+		curr = curr.next(this)) {
+		text += curr->value();
+	}
 
 	return text;
 }
 
 
-std::shared_ptr<attribute>
+attribute_ref
 node::first_attribute() const
 {
-	return this->attributes_.empty() ? nullptr : this->attributes_.front();
+	this->materialize_attributes();
+	return this->attributes_.empty() ? nullptr
+		: this->attribute_handle(this->attributes_.front());
 }
 
 
-std::shared_ptr<attribute>
+attribute_ref
 node::last_attribute() const
 {
-	return this->attributes_.empty() ? nullptr : this->attributes_.back();
+	this->materialize_attributes();
+	return this->attributes_.empty() ? nullptr
+		: this->attribute_handle(this->attributes_.back());
 }
 
 
-std::shared_ptr<attribute>
+attribute_ref
 node::get_attribute(const string_type& name) const
 {
-	auto it_attr = std::find_if(std::begin(this->attributes_),
-		std::end(this->attributes_),
-		[&](const std::shared_ptr<attribute>& attr) {
-			return attr->name() == name;
-		});
-
-	return it_attr == this->attributes_.cend() ? nullptr : *it_attr;
+	const attribute* attr = this->find_attribute_by_name(name);
+	return attr ? this->attribute_handle(*attr) : nullptr;
 }
 
 
-std::shared_ptr<attribute>
-node::append_attribute(const string_type& name, const string_type& value)
+attribute_ref
+node::append_attribute(string_type name, string_type value)
 {
-	auto attr = attribute::create(name, value);
-	this->attributes_.push_back(attr);
-	return attr;
+	this->materialize_attributes();
+	return this->attribute_handle(this->add_attribute(std::move(name),
+		std::move(value)));
 }
 
 
-std::shared_ptr<attribute>
+attribute_ref
 node::append_attribute(std::shared_ptr<attribute> attr)
 {
-	this->attributes_.push_back(attr);
-	return attr;
+	return this->append_attribute(attribute(*attr));
 }
 
 
-std::shared_ptr<attribute>
-node::prepend_attribute(const string_type& name, const string_type& value)
+attribute_ref
+node::append_attribute(const attribute_ref& attr)
 {
-	auto attr = attribute::create(name, value);
-	this->attributes_.push_front(attr);
-	return attr;
+	// Attribute is copied before insertion, because it can be stored in
+	// this node.
+	return this->append_attribute(attribute(*attr));
 }
 
 
-std::shared_ptr<attribute>
+attribute_ref
+node::append_attribute(attribute&& attr)
+{
+	this->materialize_attributes();
+	this->attributes_.push_back(std::move(attr));
+	return this->attribute_handle(this->attributes_.back());
+}
+
+
+attribute_ref
+node::prepend_attribute(string_type name, string_type value)
+{
+	this->materialize_attributes();
+	return this->attribute_handle(*this->attributes_.emplace(
+		std::begin(this->attributes_), std::move(name),
+		std::move(value)));
+}
+
+
+attribute_ref
 node::prepend_attribute(std::shared_ptr<attribute> attr)
 {
-	this->attributes_.push_front(attr);
-	return attr;
+	return this->prepend_attribute(attribute(*attr));
+}
+
+
+attribute_ref
+node::prepend_attribute(const attribute_ref& attr)
+{
+	// Attribute is copied before insertion, because it can be stored in
+	// this node.
+	return this->prepend_attribute(attribute(*attr));
+}
+
+
+attribute_ref
+node::prepend_attribute(attribute&& attr)
+{
+	this->materialize_attributes();
+	return this->attribute_handle(*this->attributes_.emplace(
+		std::begin(this->attributes_), std::move(attr)));
 }
 
 
 bool
 node::remove_attribute(const string_type& name)
 {
-	bool result = false;
-
-	this->attributes_.remove_if([&](const std::shared_ptr<attribute>& attr) {
-		result = attr->name() == name;
-		return result;
-	});
+	this->materialize_attributes();
+	auto it_end = std::remove_if(std::begin(this->attributes_),
+		std::end(this->attributes_),
+		[&](const attribute& attr) {
+			return attr.name_ == name;
+		});
+	bool result = it_end != std::end(this->attributes_);
+	this->attributes_.erase(it_end, std::end(this->attributes_));
 
 	return result;
 }
@@ -221,7 +354,7 @@ std::shared_ptr<node>
 node::next_sibling() const
 {
 	auto it_next_node = this->parent_it_;
-	auto parent = this->parent_.lock();
+	node* parent = this->parent_;
 	return parent && ++it_next_node != std::end(parent->children_)
 		? *it_next_node : nullptr;
 }
@@ -230,7 +363,7 @@ node::next_sibling() const
 std::shared_ptr<node>
 node::next_sibling(const string_type& name) const
 {
-	auto parent = this->parent_.lock();
+	node* parent = this->parent_;
 	if (!parent) {
 		return nullptr;
 	}
@@ -251,7 +384,7 @@ node::next_sibling(const string_type& name) const
 std::shared_ptr<node>
 node::previous_sibling() const
 {
-	auto parent = this->parent_.lock();
+	node* parent = this->parent_;
 	return parent && this->parent_it_ != std::begin(parent->children_)
 		? *(--node::iterator(this->parent_it_)) : nullptr;
 }
@@ -260,48 +393,44 @@ node::previous_sibling() const
 std::shared_ptr<node>
 node::previous_sibling(const string_type& name) const
 {
-	auto parent = this->parent_.lock();
+	node* parent = this->parent_;
 	if (!parent) {
 		return nullptr;
 	}
 
-	if (this->parent_it_ == std::begin(parent->children_)) {
-		return nullptr;
-	}
-
-	auto result = std::end(parent->children_);
+	// Nearest sibling is found scanning backwards from this node.
 	for (auto it_prev_sibling = this->parent_it_; it_prev_sibling
 		!= std::begin(parent->children_); ){
 
 		--it_prev_sibling;
 		if ((*it_prev_sibling)->name() == name) {
-			result = it_prev_sibling;
+			return *it_prev_sibling;
 		}
 	}
 
-	return result != std::end(parent->children_) ? *result : nullptr;
+	return nullptr;
 }
 
 
 std::shared_ptr<node>
 node::parent() const
 {
-	return this->parent_.lock();
+	return this->parent_ ? this->parent_->shared_from_this() : nullptr;
 }
 
 
 std::shared_ptr<node>
 node::root() const
 {
-	std::shared_ptr<node> result;
+	return this->ref().root().lock();
+}
 
-	auto parent = this->parent_.lock();
-	while (parent) {
-		result = parent;
-		parent = parent->parent_.lock();
-	}
 
-	return result;
+std::shared_ptr<document>
+node::owner_document() const
+{
+	return this->document_ ? std::static_pointer_cast<document>(
+		this->document_->shared_from_this()) : nullptr;
 }
 
 
@@ -330,32 +459,83 @@ node::child_value(const string_type& name) const
 void
 node::append_child(std::shared_ptr<node> _node)
 {
-	_node->parent_ = this->shared_from_this();
-	this->children_.push_back(_node);
-	_node->parent_it_ = --std::end(this->children_);
+	this->link_child(std::end(this->children_), std::move(_node));
+}
+
+
+std::shared_ptr<node>
+node::append_child(node_type type)
+{
+	this->append_child(std::shared_ptr<node>(new node(type)));
+	return this->children_.back();
 }
 
 
 void
 node::prepend_child(std::shared_ptr<node> _node)
 {
-	_node->parent_ = this->shared_from_this();
-	this->children_.push_front(_node);
-	_node->parent_it_ = std::begin(this->children_);
+	this->link_child(std::begin(this->children_), std::move(_node));
+}
+
+
+void
+node::insert_before(std::shared_ptr<node> new_child,
+	const std::shared_ptr<node>& ref_child)
+{
+	if (ref_child->parent_ != this) {
+		throw std::invalid_argument("Reference node is not a child.");
+	}
+
+	this->link_child(ref_child->parent_it_, std::move(new_child));
+}
+
+
+void
+node::insert_after(std::shared_ptr<node> new_child,
+	const std::shared_ptr<node>& ref_child)
+{
+	if (ref_child->parent_ != this) {
+		throw std::invalid_argument("Reference node is not a child.");
+	}
+
+	this->link_child(std::next(ref_child->parent_it_),
+		std::move(new_child));
 }
 
 
 bool
-node::remove_child(const string_type& name)
+node::remove()
 {
-	bool result = false;
+	node* parent = this->parent_;
+	if (!parent) {
+		return false;
+	}
 
-	this->children_.remove_if([&](const std::shared_ptr<node>& child) {
-		result = true;
-		return child->name() == name;
-	});
+	// Parent might hold the last reference to this node, so the node is
+	// destroyed only when the method returns.
+	std::shared_ptr<node> self = std::move(*this->parent_it_);
+	parent->children_.erase(this->parent_it_);
+	this->parent_ = nullptr;
+	if (this->document_) {
+		this->set_owner_document(nullptr);
+	}
 
-	return result;
+	return true;
+}
+
+
+void
+node::move_to(const std::shared_ptr<node>& new_parent)
+{
+	new_parent->append_child(this->shared_from_this());
+}
+
+
+bool
+node::remove_child(const string_type& name)
+{
+	auto child = this->child(name);
+	return child && child->remove();
 }
 
 
@@ -396,7 +576,7 @@ node::find_child_by_attribute(const string_type& tag,
 				return false;
 			}
 
-			std::shared_ptr<attribute> attr =
+			attribute_ref attr =
 				child->get_attribute(attr_name);
 			return attr && attr->value() == attr_value;
 		});
@@ -413,7 +593,7 @@ node::find_child_by_attribute(const string_type& attr_name,
 		std::end(this->children_),
 		[&](const std::shared_ptr<node>& child) {
 
-			std::shared_ptr<attribute> attr =
+			attribute_ref attr =
 				child->get_attribute(attr_name);
 			return attr && attr->value() == attr_value;
 		});
@@ -425,14 +605,20 @@ node::find_child_by_attribute(const string_type& attr_name,
 string_type
 node::path(char_type delimiter) const
 {
-	string_type result = this->name();
+	// Names are appended in reverse and the result is reversed back, so
+	// path is built in linear time.
+	string_type result;
+	for (const node* curr_node = this; curr_node != nullptr; ) {
+		if (curr_node != this) {
+			result += delimiter;
+		}
+		const string_type& name = curr_node->name();
+		result.append(name.rbegin(), name.rend());
 
-	auto curr_node = this->parent();
-	while (curr_node) {
-		result = curr_node->name() + delimiter + result;
-		curr_node = curr_node->parent();
+		curr_node = curr_node->parent_;
 	}
 
+	std::reverse(result.begin(), result.end());
 	return result;
 }
 
@@ -457,34 +643,35 @@ node::traverse(node_walker& walker)
 		return false;
 	}
 
+	// Tree is navigated by node references, so only nodes passed to the
+	// walker are reference counted.
 	walker.depth_ = 0;
-	std::shared_ptr<node> child = this->first_child();
+	node_ref child = this->ref().first_child();
 	if (child) {
 		++walker.depth_;
 
 		do {
-			if (!walker.for_each(child)) {
+			if (!walker.for_each(child.lock())) {
 				return false;
 			}
 
-			if (child->first_child()) {
+			if (child.first_child()) {
 				++walker.depth_;
-				child = child->first_child();
+				child = child.first_child();
 			}
-			else if (child->next_sibling()) {
-				child = child->next_sibling();
+			else if (child.next_sibling()) {
+				child = child.next_sibling();
 			}
 			else {
-				// Borland C++ workaround
-				while (!child->next_sibling()
+				while (!child.next_sibling()
 					&& walker.depth_ > 0
-					&& child->parent()) {
+					&& child.parent()) {
 					--walker.depth_;
-					child = child->parent();
+					child = child.parent();
 				}
 
 				if (walker.depth_ > 0) {
-					child = child->next_sibling();
+					child = child.next_sibling();
 				}
 			}
 		}
@@ -506,8 +693,11 @@ node::traverse(std::function<bool (std::shared_ptr<node>)> predicate,
 		}
 	}
 
-	for (auto child : this->children_) {
-		bool proceed = child->traverse(predicate, depth + 1);
+	// Subtree is walked iteratively, so that deep trees would not overflow
+	// the stack.
+	for (node_ref child = this->ref().first_child(); child;
+		child = child.next(this)) {
+		bool proceed = predicate(child.lock());
 		if (!proceed) {
 			return false;
 		}
@@ -534,14 +724,107 @@ node::end()
 node::attribute_iterator
 node::attributes_begin()
 {
-	return std::begin(this->attributes_);
+	this->materialize_attributes();
+	return this->attributes_.data();
 }
 
 
 node::attribute_iterator
 node::attributes_end()
 {
-	return std::end(this->attributes_);
+	this->materialize_attributes();
+	return this->attributes_.data() + this->attributes_.size();
+}
+
+
+void
+node::materialize_attributes() const
+{
+	if (this->raw_attributes_.empty()) {
+		return;
+	}
+
+	// Raw attributes are cleared first, because parsed attributes are
+	// appended with append_attribute().
+	string_type raw_attributes;
+	raw_attributes.swap(this->raw_attributes_);
+	parser::parse_attributes(raw_attributes, const_cast<node&>(*this));
+}
+
+
+attribute&
+node::add_attribute(string_type name, string_type value)
+{
+	this->attributes_.emplace_back(std::move(name), std::move(value));
+	return this->attributes_.back();
+}
+
+
+attribute_ref
+node::attribute_handle(const attribute& attr) const
+{
+	return attribute_ref(this, &attr - this->attributes_.data());
+}
+
+
+void
+node::link_child(iterator pos, std::shared_ptr<node> child)
+{
+	node* child_node = child.get();
+	// Node can't become a descendant of itself. Leaves, which parser
+	// appends, and nodes of another document can't be ancestors of this
+	// node, so only the remaining ones are looked for up the tree.
+	if (child_node == this) {
+		throw std::invalid_argument("Node can't be its own child.");
+	}
+	if (!child_node->children_.empty()
+		&& child_node->document_ == this->document_) {
+		for (node_ref curr = this->parent_; curr; curr = curr.parent()) {
+			if (curr == child_node) {
+				throw std::invalid_argument(
+					"Node can't be inserted into its subtree.");
+			}
+		}
+	}
+
+	// Node which is already in a tree is spliced out of its parent child
+	// list. Its list element, and so parent_it_, stays the same.
+	if (child_node->parent_) {
+		this->children_.splice(pos, child_node->parent_->children_,
+			child_node->parent_it_);
+	}
+	else {
+		child_node->parent_it_ = this->children_.insert(pos,
+			std::move(child));
+	}
+
+	child_node->parent_ = this;
+	if (child_node->document_ != this->document_) {
+		child_node->set_owner_document(this->document_);
+	}
+}
+
+
+void
+node::set_owner_document(node* doc)
+{
+	for (node_ref curr = this; curr; curr = curr.next(this)) {
+		const_cast<node*>(curr.get())->document_ = doc;
+	}
+}
+
+
+const attribute*
+node::find_attribute_by_name(const string_type& name) const
+{
+	this->materialize_attributes();
+	for (auto& attr : this->attributes_) {
+		if (attr.name_ == name) {
+			return &attr;
+		}
+	}
+
+	return nullptr;
 }
 
 
@@ -587,13 +870,60 @@ make_end_tag_name(std::size_t indentation, string_type tag_name)
 string_type
 node::to_string(std::size_t indentation) const
 {
-	string_type str_html = make_start_tag_name(indentation, this->name());
+	string_type str_html = make_start_tag_name(indentation,
+		this->source_name());
+
+	// Subtree is walked iteratively, so that deep trees would not overflow
+	// the stack.
+	std::size_t depth = 1;
+	node_ref child = this->ref().first_child();
+	while (child) {
+		str_html += make_start_tag_name(indentation + depth,
+			child->source_name());
+
+		if (child.first_child()) {
+			child = child.first_child();
+			++depth;
+			continue;
+		}
+
+		str_html += make_end_tag_name(indentation + depth,
+			child->source_name());
+
+		while (child != this && !child.next_sibling()) {
+			child = child.parent();
+			--depth;
+
+			if (child != this) {
+				str_html += make_end_tag_name(indentation + depth,
+					child->source_name());
+			}
+		}
+
+		child = child != this ? child.next_sibling() : nullptr;
+	}
+
+	return str_html + make_end_tag_name(indentation,
+		this->source_name());
+}
+
 
-	for (auto node : this->children_) {
-		str_html += node->to_string(indentation + 1);
+attribute&
+attribute_ref::operator*() const
+{
+	attribute* attr = this->get();
+	if (!attr) {
+		throw std::out_of_range("Attribute handle is empty.");
 	}
 
-	return str_html + make_end_tag_name(indentation, this->name());
+	return *attr;
+}
+
+
+std::shared_ptr<node>
+attribute_ref::owner() const
+{
+	return this->get() ? this->owner_->shared_from_this() : nullptr;
 }
 
 
@@ -1,12 +1,20 @@
 #include <cassert>
-#include <cstring>
 #include <stdexcept>
 #include <algorithm>
-#include <list>
-#include <locale>
 #include <sstream>
 #include <unordered_map>
 #include <set>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#if defined(__SSE2__) && !defined(PUGIHTML_WCHAR_MODE)
+#include <emmintrin.h>
+#endif
 
 #include <cpp-html/attribute.hpp>
 #include <cpp-html/node.hpp>
@@ -41,6 +49,31 @@ const unsigned char chartype_table[256] = {
 };
 
 
+/**
+ * This table maps ASCII symbols to their upper case. Other symbols are mapped
+ * to themselves.
+ */
+const unsigned char toupper_table[256] = {
+	  0,   1,   2,   3,   4,   5,   6,   7,      8,   9,  10,  11,  12,  13,  14,  15, // 0-15
+	 16,  17,  18,  19,  20,  21,  22,  23,     24,  25,  26,  27,  28,  29,  30,  31, // 16-31
+	 32,  33,  34,  35,  36,  37,  38,  39,     40,  41,  42,  43,  44,  45,  46,  47, // 32-47
+	 48,  49,  50,  51,  52,  53,  54,  55,     56,  57,  58,  59,  60,  61,  62,  63, // 48-63
+	 64,  65,  66,  67,  68,  69,  70,  71,     72,  73,  74,  75,  76,  77,  78,  79, // 64-79
+	 80,  81,  82,  83,  84,  85,  86,  87,     88,  89,  90,  91,  92,  93,  94,  95, // 80-95
+	 96,  65,  66,  67,  68,  69,  70,  71,     72,  73,  74,  75,  76,  77,  78,  79, // 96-111
+	 80,  81,  82,  83,  84,  85,  86,  87,     88,  89,  90, 123, 124, 125, 126, 127, // 112-127
+
+	128, 129, 130, 131, 132, 133, 134, 135,    136, 137, 138, 139, 140, 141, 142, 143, // 128+
+	144, 145, 146, 147, 148, 149, 150, 151,    152, 153, 154, 155, 156, 157, 158, 159,
+	160, 161, 162, 163, 164, 165, 166, 167,    168, 169, 170, 171, 172, 173, 174, 175,
+	176, 177, 178, 179, 180, 181, 182, 183,    184, 185, 186, 187, 188, 189, 190, 191,
+	192, 193, 194, 195, 196, 197, 198, 199,    200, 201, 202, 203, 204, 205, 206, 207,
+	208, 209, 210, 211, 212, 213, 214, 215,    216, 217, 218, 219, 220, 221, 222, 223,
+	224, 225, 226, 227, 228, 229, 230, 231,    232, 233, 234, 235, 236, 237, 238, 239,
+	240, 241, 242, 243, 244, 245, 246, 247,    248, 249, 250, 251, 252, 253, 254, 255
+};
+
+
 inline bool
 is_chartype(char_type ch, enum chartype_t char_type)
 {
@@ -66,6 +99,65 @@ skip_white_spaces(const char_type* str)
 	return str;
 }
 
+/**
+ * Scans plain character data until '<' or '\0' is found.
+ * When SSE2 is available, 16 characters are checked at once while they all
+ * fit before the end of html string.
+ *
+ * @param end pointer past the last character of html string.
+ * @param whitespace_only set to true if all the scanned characters are
+ *	white spaces.
+ * @return pointer to the first character past the character data.
+ */
+inline const char_type*
+scan_pcdata(const char_type* s, const char_type* end, bool& whitespace_only)
+{
+	whitespace_only = true;
+
+#if defined(__SSE2__) && !defined(PUGIHTML_WCHAR_MODE)
+	const __m128i tag_open = _mm_set1_epi8('<');
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i carriage_return = _mm_set1_epi8('\r');
+
+	while (end - s >= 16) {
+		__m128i chunk = _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(s));
+
+		int stop_mask = _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(chunk, tag_open),
+			_mm_cmpeq_epi8(chunk, zero)));
+		int space_mask = _mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+				_mm_cmpeq_epi8(chunk, tab)),
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, newline),
+				_mm_cmpeq_epi8(chunk, carriage_return))));
+
+		if (stop_mask != 0) {
+			int pcdata_len = __builtin_ctz(stop_mask);
+			int pcdata_mask = (1 << pcdata_len) - 1;
+			whitespace_only = whitespace_only
+				&& (space_mask & pcdata_mask) == pcdata_mask;
+			return s + pcdata_len;
+		}
+
+		whitespace_only = whitespace_only && space_mask == 0xffff;
+		s += 16;
+	}
+#else
+	(void)end;
+#endif
+
+	while (!is_chartype(*s, ct_parse_pcdata)) {
+		whitespace_only = whitespace_only && is_chartype(*s, ct_space);
+		++s;
+	}
+
+	return s;
+}
+
 #define THROW_ERROR(err, m) (void)m, throw parse_error(err)
 
 #define SCANFOR(X)			{ while (*s != 0 && !(X)) ++s; }
@@ -76,10 +168,38 @@ skip_white_spaces(const char_type* str)
 #define ENDSWITH(c, e) ((c) == (e) || ((c) == 0 && endch == (e)))
 
 
-// TODO(povilas): replace with set for faster search.
-std::list<string_type> html_void_elements = {"AREA", "BASE", "BR",
-	"COL", "EMBED", "HR", "IMG", "INPUT", "KEYGEN", "LINK", "MENUITEM",
-	"META", "PARAM", "SOURCE", "TRACK", "WBR"};
+enum element_flag_t {
+	// Element has no content and no end tag, e.g. <br>.
+	ef_void = 1,
+
+	// Element content is raw text up to the matching end tag, e.g. <script>.
+	ef_raw_text = 2,
+
+	// Element content is escapable raw text up to the matching end tag,
+	// e.g. <textarea>. Character references are not expanded by the parser
+	// yet, so it's treated the same way as raw text.
+	ef_rcdata = 4
+};
+
+
+/**
+ * This table maps HTML element names with their flags in enum element_flag_t.
+ * Elements not listed here have no flags.
+ */
+const std::unordered_map<string_type, unsigned int> element_flags_table = {
+	{"AREA", ef_void}, {"BASE", ef_void}, {"BR", ef_void},
+	{"COL", ef_void}, {"EMBED", ef_void}, {"HR", ef_void},
+	{"IMG", ef_void}, {"INPUT", ef_void}, {"KEYGEN", ef_void},
+	{"LINK", ef_void}, {"MENUITEM", ef_void}, {"META", ef_void},
+	{"PARAM", ef_void}, {"SOURCE", ef_void}, {"TRACK", ef_void},
+	{"WBR", ef_void},
+
+	{"SCRIPT", ef_raw_text}, {"STYLE", ef_raw_text}, {"XMP", ef_raw_text},
+	{"IFRAME", ef_raw_text}, {"NOEMBED", ef_raw_text},
+	{"NOFRAMES", ef_raw_text}, {"NOSCRIPT", ef_raw_text},
+
+	{"TEXTAREA", ef_rcdata}, {"TITLE", ef_rcdata}
+};
 
 
 // End tag might be ommited for some elements, if they are followed by specific
@@ -133,12 +253,101 @@ autoclose_last_child(const std::string& tag_name)
 }
 
 
-inline bool
-is_void_element(const std::string& tag_name)
+/**
+ * @param tag_name upper case element name.
+ * @return flags from enum element_flag_t for the specified element.
+ */
+inline unsigned int
+element_flags(const string_type& tag_name)
+{
+	auto it = element_flags_table.find(tag_name);
+	return it != std::end(element_flags_table) ? it->second : 0;
+}
+
+
+/**
+ * Converts ASCII letter to upper case. Does not depend on locale.
+ */
+inline char_type
+ascii_toupper(char_type ch)
+{
+#ifdef PUGIHTML_WCHAR_MODE
+	return static_cast<unsigned int>(ch) < 128
+		? toupper_table[static_cast<unsigned int>(ch)] : ch;
+#else
+	return toupper_table[static_cast<unsigned char>(ch)];
+#endif
+}
+
+
+/**
+ * Searches for the end tag of raw text element, e.g. </script>. Tag name is
+ * compared ignoring case and it must be followed by white space, '/' or '>'.
+ *
+ * @param end pointer past the last character of html string.
+ * @param tag_name upper case element name.
+ * @return pointer to the '<' of the end tag or end, if end tag was not found.
+ */
+inline const char_type*
+find_raw_text_end(const char_type* s, const char_type* end,
+	const string_type& tag_name)
+{
+	const std::size_t tag_name_len = tag_name.size();
+
+	while (true) {
+		s = std::char_traits<char_type>::find(s, end - s, '<');
+		if (s == nullptr
+			|| static_cast<std::size_t>(end - s) <= tag_name_len + 2) {
+			return end;
+		}
+
+		if (s[1] == '/') {
+			const char_type* name = s + 2;
+			std::size_t i = 0;
+			while (i < tag_name_len
+				&& ascii_toupper(name[i]) == tag_name[i]) {
+				++i;
+			}
+
+			char_type name_end = name[tag_name_len];
+			if (i == tag_name_len && (is_chartype(name_end, ct_space)
+				|| name_end == '/' || name_end == '>')) {
+				return s;
+			}
+		}
+
+		++s;
+	}
+}
+
+
+/**
+ * Counts estimated heap allocations of a DOM tree object: the object
+ * itself, its shared_ptr control block and the list node holding it.
+ */
+template <typename T> void
+count_object_allocations(parse_stats& stats)
+{
+	stats.allocations += 3;
+	stats.allocated_bytes += sizeof(T) + 3 * sizeof(void*)
+		+ 2 * sizeof(void*) + sizeof(std::shared_ptr<T>);
+}
+
+
+/**
+ * Counts heap allocation of string, which does not fit into the small
+ * string buffer.
+ */
+inline void
+count_string_allocation(parse_stats& stats, std::size_t length)
 {
-	auto it = std::find(std::begin(html_void_elements),
-		std::end(html_void_elements), tag_name);
-	return it != std::end(html_void_elements);
+	static const std::size_t small_string_capacity = string_type()
+		.capacity();
+
+	if (length > small_string_capacity) {
+		++stats.allocations;
+		stats.allocated_bytes += (length + 1) * sizeof(char_type);
+	}
 }
 
 
@@ -249,124 +458,77 @@ parser::parser(unsigned int options) : options_(options),
 }
 
 
-const char_type*
-parser::parse_exclamation(const char_type* s, char_type endch)
+void
+parser::reset()
 {
-	// Skip '<!'.
-	s += 2;
-
-	// '<!-...' - comment.
-	if (*s == '-') {
-		++s;
-		if (*s != '-') {
-			THROW_ERROR(status_bad_comment, s);
-		}
-
-		++s;
-		const char_type* comment_start = s;
-
-		// Scan for terminating '-->'.
-		SCANFOR(s[0] == '-' && s[1] == '-'
-			&& ENDSWITH(s[2], '>'));
-		CHECK_ERROR(status_bad_comment, s);
-
-		if (this->option_set(parse_comments)) {
-			// TODO(povilas): if this->option_set(parse_eol),
-			// replace \r\n to \n.
-			size_t comment_len = (s - 1) - comment_start + 1;
-			string_type comment(comment_start, comment_len);
-
-			auto comment_node = node::create(node_comment);
-			comment_node->value(comment);
-
-			this->current_node_->append_child(comment_node);
-		}
-
-		// Step over the '\0->'.
-		s += (s[2] == '>' ? 3 : 2);
-	}
-	// '<![CDATA[...'
-	else if (*s == '[') {
-		if (!(*++s=='C' && *++s=='D' && *++s=='A' && *++s=='T'
-			&& *++s=='A' && *++s == '[')) {
-			THROW_ERROR(status_bad_cdata, s);
-		}
-
-		++s;
-		const char_type* cdata_start = s;
-
-		SCANFOR(s[0] == ']' && s[1] == ']'
-			&& ENDSWITH(s[2], '>'));
-		CHECK_ERROR(status_bad_cdata, s);
-
-		if (this->option_set(parse_cdata)) {
-			// TODO(povilas): if this->option_set(parse_eol),
-			// replace \r\n to \n.
-			size_t cdata_len = s - cdata_start + 1;
-			string_type cdata(cdata_start, cdata_len);
+	this->status_ = status_ok;
+	this->document_ = document::create();
+	this->current_node_ = this->document_;
+	this->node_count_ = 0;
+	this->depth_ = 0;
+}
 
-			auto node = node::create(node_cdata);
-			node->value(cdata);
-			this->current_node_->append_child(node);
-		}
 
-		++s;
-		s += (s[1] == '>' ? 2 : 1); // Step over the last ']>'.
+inline void
+str_toupper(string_type& str)
+{
+	for (auto it = std::begin(str); it != std::end(str); ++it) {
+		*it = ascii_toupper(*it);
 	}
-	// <!DOCTYPE
-	else if (s[0] == 'D' && s[1] == 'O' && s[2] == 'C' && s[3] == 'T'
-		&& s[4] == 'Y' && s[5] == 'P' && ENDSWITH(s[6], 'E')) {
-		s -= 2;
-
-		const char_type* doctype_start = s + 9;
-
-		s = advance_doctype_group(s, endch);
+}
 
-		if (this->option_set(parse_doctype)) {
-			while (is_chartype(*doctype_start, ct_space)) {
-				++doctype_start;
-			}
 
-			assert(s[-1] == '>');
-			size_t doctype_len = (s - 2) - doctype_start + 1;
-			string_type doctype(doctype_start, doctype_len);
+/**
+ * Scans element or attribute name starting at the specified position.
+ * Name is converted to upper case while it's copied.
+ *
+ * @param name upper case name is written here.
+ * @return pointer past the name.
+ */
+inline const char_type*
+scan_name(const char_type* s, string_type& name)
+{
+	const char_type* name_start = s;
+	SCANWHILE(is_chartype(*s, ct_symbol));
 
-			auto node = node::create(node_doctype);
-			node->value(doctype);
-			this->current_node_->append_child(node);
-		}
+	name.resize(s - name_start);
+	for (std::size_t i = 0; i < name.size(); ++i) {
+		name[i] = ascii_toupper(name_start[i]);
 	}
-	else if (*s == 0 && endch == '-') THROW_ERROR(status_bad_comment, s);
-	else if (*s == 0 && endch == '[') THROW_ERROR(status_bad_cdata, s);
-	else THROW_ERROR(status_unrecognized_tag, s);
 
 	return s;
 }
 
 
-inline void
-str_toupper(string_type& str)
+/**
+ * @return true if upper case name is spelled differently in html.
+ */
+inline bool
+spelled_differently(const string_type& name, const char_type* name_start)
 {
-	std::locale loc;
-	for (auto it = std::begin(str); it != std::end(str); ++it) {
-		*it = std::toupper(*it, loc);
-	}
+	return !std::equal(std::begin(name), std::end(name), name_start);
 }
 
 
+/**
+ * @param depth depth of the current node. It's updated to the depth of
+ *	returned node.
+ */
 std::shared_ptr<node>
 find_parent_node_for_new_tag(std::shared_ptr<node> current_node,
-	const string_type& new_tag_name)
+	const string_type& new_tag_name, std::size_t& depth)
 {
 	auto new_tag_parent = current_node;
 
 	auto parent = current_node->parent();
 	if (parent && autoclose_prev_sibling(new_tag_name,
 		current_node->name())) {
+		--depth;
 
 		while (parent->parent() && autoclose_prev_sibling(new_tag_name,
 			parent->name())) {
 			parent = parent->parent();
+			--depth;
 		}
 
 		new_tag_parent = parent;
@@ -376,146 +538,812 @@ find_parent_node_for_new_tag(std::shared_ptr<node> current_node,
 }
 
 
-std::shared_ptr<document>
-parser::parse(const string_type& str_html)
+/**
+ * @return pointer past the first occurrence of the specified character or
+ *	end, if it was not found.
+ */
+inline const char_type*
+skip_past(const char_type* s, const char_type* end, char_type ch)
 {
-	this->status_ = status_ok;
-
-	if (str_html.size() == 0) {
-		return this->document_;
-	}
+	s = std::char_traits<char_type>::find(s, end - s, ch);
+	return s != nullptr ? s + 1 : end;
+}
 
-	const char_type* s = str_html.c_str();
 
-	// Flag indicating if last parsed tag is void html element.
-	bool last_element_void = false;
+/**
+ * Advances past the rest of the start tag: attributes and the closing '>'.
+ * Quoted attribute values might contain '>' symbols.
+ *
+ * @param self_closing set to true if start tag ends with "/>".
+ * @return pointer past the '>' or end, if it was not found.
+ */
+inline const char_type*
+skip_start_tag_rest(const char_type* s, const char_type* end,
+	bool& self_closing)
+{
+	self_closing = false;
+	char_type quote_symbol = 0;
 
-	auto on_tag_start = [&](const std::string& tag_name) {
-		if (last_element_void) {
-			this->current_node_ = this->current_node_->parent();
-			last_element_void = false;
+	for (; s < end; ++s) {
+		if (quote_symbol) {
+			if (*s == quote_symbol) {
+				quote_symbol = 0;
+			}
+		}
+		else if (*s == '"' || *s == '\'') {
+			quote_symbol = *s;
 		}
+		else if (*s == '>') {
+			self_closing = s[-1] == '/';
+			return s + 1;
+		}
+	}
 
-		auto node = node::create(node_element);
-		node->name(tag_name);
+	return end;
+}
 
-		auto new_tag_parent = find_parent_node_for_new_tag(
-			this->current_node_, tag_name);
-		new_tag_parent->append_child(node);
 
-		this->current_node_ = node;
-	};
+/**
+ * Advances past the content and the end tag of skipped element. No nodes are
+ * created, only the names of elements open inside the skipped one are
+ * tracked, so that implied end tags are resolved the same way as when DOM
+ * tree is built.
+ *
+ * @param s pointer past the start tag of skipped element.
+ * @param end pointer past the last character of html string.
+ * @param tag_name upper case name of skipped element.
+ * @param open_elements scratch stack for open element names.
+ * @param name scratch buffer for scanned tag names.
+ * @return pointer past the end tag of skipped element or pointer to the tag
+ *	which implicitly closes skipped element.
+ */
+const char_type*
+skip_element_content(const char_type* s, const char_type* end,
+	const string_type& tag_name, std::vector<string_type>& open_elements,
+	string_type& name)
+{
+	static const char_type comment_end[] = {'-', '-', '>'};
+	static const char_type cdata_start[] = {'[', 'C', 'D', 'A', 'T', 'A',
+		'['};
+	static const char_type cdata_end[] = {']', ']', '>'};
+
+	open_elements.clear();
+	open_elements.push_back(tag_name);
+	while (true) {
+		const char_type* tag_start =
+			std::char_traits<char_type>::find(s, end - s, '<');
+		if (tag_start == nullptr) {
+			return end;
+		}
 
-	auto on_closing_tag = [&](const std::string& tag_name) {
-		if (tag_name != this->current_node_->name()
-			&& (autoclose_last_child(this->current_node_->name())
-			|| last_element_void)) {
+		s = tag_start + 1;
 
-			if (last_element_void) {
-				this->current_node_ = this->current_node_->parent();
+		// Comment, CDATA section or doctype.
+		if (*s == '!') {
+			if (s[1] == '-' && s[2] == '-') {
+				s = std::search(s + 3, end, comment_end,
+					comment_end + 3);
+				s = s != end ? s + 3 : end;
 			}
-			else while (autoclose_last_child(
-				this->current_node_->name())) {
-				this->current_node_ = this->current_node_->parent();
+			// CDATA section may contain markup, e.g. "a > <b>".
+			else if (end - s > 8 && std::equal(cdata_start,
+				cdata_start + 7, s + 1)) {
+				s = std::search(s + 8, end, cdata_end,
+					cdata_end + 3);
+				s = s != end ? s + 3 : end;
+			}
+			else {
+				s = skip_past(s, end, '>');
 			}
-
-			last_element_void = false;
 		}
+		// End tag.
+		else if (*s == '/') {
+			s = skip_past(scan_name(s + 1, name), end, '>');
+			if (name.empty() || (element_flags(name) & ef_void)) {
+				continue;
+			}
 
-		const string_type& expected_name = this->current_node_->name();
-		if (expected_name != tag_name) {
-			std::string err_msg = "Expected: '" + expected_name
-				+ "', found: '" + tag_name + "'";
-			throw parse_error(status_end_element_mismatch, str_html,
-				s, err_msg);
-		}
+			while (!open_elements.empty()
+				&& open_elements.back() != name
+				&& autoclose_last_child(open_elements.back())) {
+				open_elements.pop_back();
+			}
 
-		if (this->current_node_->parent()) {
-			this->current_node_ = this->current_node_->parent();
-			last_element_void = false;
-		}
-	};
+			if (open_elements.empty()) {
+				return tag_start;
+			}
 
-	auto on_pcdata = [&](const std::string& pcdata) {
-		if (last_element_void) {
-			this->current_node_ = this->current_node_->parent();
-			last_element_void = false;
+			if (open_elements.back() == name) {
+				open_elements.pop_back();
+				if (open_elements.empty()) {
+					return s;
+				}
+			}
+			// End tag of skipped element ancestor.
+			else if (open_elements.size() == 1) {
+				return tag_start;
+			}
 		}
+		// Start tag.
+		else if (is_chartype(*s, ct_start_symbol)) {
+			s = scan_name(s, name);
 
-		auto node = node::create(node_cdata);
-		node->value(pcdata);
-		this->current_node_->append_child(node);
-	};
-
-	auto on_attribute = [&](const std::string& attr_name,
-		const std::string& attr_val) {
-		auto attr = attribute::create(attr_name, attr_val);
-		this->current_node_->append_attribute(attr);
-	};
-
-	auto on_script = [&](const string_type& script_value) {
-		auto node = node::create(node_cdata);
-		node->value(script_value);
-		this->current_node_->append_child(node);
-	};
-
-	auto parse_pcdata = [&]() {
-		const char_type* pcdata_start = s;
-		while (!is_chartype(*s, ct_parse_pcdata)) {
-			++s;
-		}
+			while (!open_elements.empty() && autoclose_prev_sibling(
+				name, open_elements.back())) {
+				open_elements.pop_back();
+			}
 
-		size_t pcdata_len = (s - 1) - pcdata_start + 1;
-		string_type pcdata = string_type(pcdata_start,
-			pcdata_len);
+			if (open_elements.empty()) {
+				return tag_start;
+			}
 
-		on_pcdata(pcdata);
-	};
+			bool self_closing = false;
+			s = skip_start_tag_rest(s, end, self_closing);
 
-	auto parse_script = [&]() {
-		const char_type* script_value_start = s;
-		const char_type* script_value_end = s;
+			unsigned int flags = element_flags(name);
+			if (self_closing || (flags & ef_void)) {
+				continue;
+			}
 
-		while (*s != '\0') {
-			if (strncmp(s, "</script>", 9) == 0) {
-				script_value_end = s - 1;
-				break;
+			if (flags & (ef_raw_text | ef_rcdata)) {
+				s = skip_past(find_raw_text_end(s, end, name), end,
+					'>');
 			}
 			else {
-				++s;
+				open_elements.push_back(name);
 			}
 		}
+	}
+}
 
-		size_t script_value_len = script_value_end - script_value_start
-			+ 1;
-		string_type script_value = string_type(script_value_start,
-			script_value_len);
 
-		on_script(script_value);
-	};
+/**
+ * Checks if '/' before start tag end belongs to unquoted attribute value,
+ * e.g. <a href=/>, rather than makes the tag self-closing.
+ *
+ * @param start start of attributes markup.
+ * @param slash pointer to '/'.
+ */
+inline bool
+ends_unquoted_value(const char_type* start, const char_type* slash)
+{
+	const char_type* s = slash;
+	while (s > start && !is_chartype(s[-1], ct_space) && s[-1] != '"'
+		&& s[-1] != '\'' && s[-1] != '=') {
+		--s;
+	}
 
-	auto on_attribute_name_state = [&]() {
-		const char_type* attr_name_start = s;
+	while (s > start && is_chartype(s[-1], ct_space)) {
+		--s;
+	}
 
-		SCANWHILE(is_chartype(*s, ct_symbol));
-		if (*s == '\0') {
-			throw parse_error(status_bad_attribute, str_html, s);
-		}
+	return s > start && s[-1] == '=';
+}
 
-		size_t attr_name_len = (s - 1) - attr_name_start + 1;
-		string_type attr_name = string_type(attr_name_start, attr_name_len);
-		str_toupper(attr_name);
 
-		s = skip_white_spaces(s);
-		if (*s == '\0') {
-			throw parse_error(status_bad_attribute, str_html, s);
-		}
+/**
+ * Builds DOM tree from markup reported by parser::scan(). It keeps all the
+ * tree construction state, so the same rules are applied whether html is
+ * scanned on the same thread, like in parse(), or on another one, like in
+ * parse_pipelined().
+ */
+class parser::tree_builder {
+public:
+	/**
+	 * @param str_html scanned html, used in error messages.
+	 */
+	tree_builder(parser& owner, const string_type& str_html)
+		: parser_(owner), str_html_(str_html)
+	{
+	}
 
-		string_type attr_val;
-		// Attribute with value.
-		if (*s == '=') {
-			++s;
-			s = skip_white_spaces(s);
+	/**
+	 * Checks if elements filter is set to keep only some elements and
+	 * parser is currently outside of them.
+	 */
+	bool
+	outside_kept_elements() const
+	{
+		return this->parser_.filter_mode_ == filter_keep
+			&& (this->parser_.current_node_ == this->parser_.document_
+			|| (this->last_element_void_
+			&& this->parser_.current_node_->parent()
+			== this->parser_.document_));
+	}
+
+	/**
+	 * Checks if node should be created for the element according to the
+	 * elements filter.
+	 */
+	bool
+	build_element(const string_type& tag_name) const
+	{
+		switch (this->parser_.filter_mode_) {
+		case filter_skip:
+			return this->parser_.filter_elements_.count(tag_name) == 0;
+
+		case filter_keep:
+			return this->parser_.filter_elements_.count(tag_name) != 0
+				|| !this->outside_kept_elements();
+
+		default:
+			return true;
+		}
+	}
+
+	/**
+	 * Checks if end tag closes an element which was not built because
+	 * of elements filter.
+	 */
+	bool
+	closes_filtered_element(const string_type& tag_name)
+	{
+		if (this->parser_.filter_mode_ != filter_keep) {
+			return false;
+		}
+
+		if (this->outside_kept_elements()) {
+			return true;
+		}
+
+		for (auto open_node = this->parser_.current_node_;
+			open_node != this->parser_.document_;
+			open_node = open_node->parent()) {
+
+			if (open_node->name() == tag_name) {
+				return false;
+			}
+		}
+
+		// End tag of element enclosing the kept one closes it as well.
+		this->parser_.current_node_ = this->parser_.document_;
+		this->parser_.depth_ = 0;
+		this->last_element_void_ = false;
+
+		return true;
+	}
+
+	/**
+	 * Opens new element.
+	 *
+	 * @param tag_name upper case element name.
+	 * @param tag_name_start element name in html.
+	 */
+	void
+	start_tag(const string_type& tag_name, const char_type* tag_name_start)
+	{
+		if (this->last_element_void_) {
+			this->close_current_node();
+			this->last_element_void_ = false;
+		}
+
+		parser& p = this->parser_;
+		p.count_node();
+		std::size_t depth = p.depth_;
+		auto new_tag_parent = find_parent_node_for_new_tag(
+			p.current_node_, tag_name, p.depth_);
+		auto node = new_tag_parent->append_child(node_element);
+		node->name(tag_name);
+		if (spelled_differently(tag_name, tag_name_start)) {
+			node->source_name(string_type(tag_name_start,
+				tag_name.size()));
+		}
+
+		p.current_node_ = node;
+		p.check_limit(++p.depth_, p.limits_.max_depth,
+			status_depth_limit_exceeded);
+		this->attribute_count_ = 0;
+
+		if (p.stats_) {
+			++p.stats_->elements;
+			p.stats_->implied_end_tags += depth + 1 - p.depth_;
+			p.stats_->max_depth = std::max(p.stats_->max_depth,
+				p.depth_);
+			count_object_allocations<cpphtml::node>(*p.stats_);
+			count_string_allocation(*p.stats_, tag_name.size());
+		}
+	}
+
+	/**
+	 * Appends attribute to the element opened last.
+	 *
+	 * @param attr_name upper case attribute name.
+	 * @param attr_name_start attribute name in html.
+	 */
+	void
+	attribute(const string_type& attr_name,
+		const char_type* attr_name_start, string_type&& attr_val)
+	{
+		parser& p = this->parser_;
+		p.check_limit(++this->attribute_count_,
+			p.limits_.max_attributes,
+			status_attribute_limit_exceeded);
+
+		auto& attributes = p.current_node_->attributes_;
+		std::size_t capacity = attributes.capacity();
+		auto& attr = p.current_node_->add_attribute(attr_name,
+			std::move(attr_val));
+		if (spelled_differently(attr_name, attr_name_start)) {
+			attr.source_name(string_type(attr_name_start,
+				attr_name.size()));
+		}
+
+		if (p.stats_) {
+			++p.stats_->attributes;
+			count_string_allocation(*p.stats_, attr_name.size());
+			count_string_allocation(*p.stats_, attr.value().size());
+
+			if (attributes.capacity() != capacity) {
+				++p.stats_->allocations;
+				p.stats_->allocated_bytes += attributes.capacity()
+					* sizeof(cpphtml::attribute);
+			}
+		}
+	}
+
+	/**
+	 * Keeps start tag markup after element name to be parsed into
+	 * attributes on first access.
+	 */
+	void
+	raw_attributes(const char_type* start, const char_type* end)
+	{
+		parser& p = this->parser_;
+		p.current_node_->raw_attributes_.assign(start, end);
+
+		if (p.stats_) {
+			count_string_allocation(*p.stats_, end - start);
+		}
+	}
+
+	/**
+	 * Finishes start tag of the element opened last. Void element is
+	 * closed by the next tag or text.
+	 */
+	void
+	start_tag_end(bool void_element)
+	{
+		this->last_element_void_ = void_element;
+	}
+
+	/**
+	 * Closes element by its end tag and elements it implicitly closes.
+	 *
+	 * @param tag_name upper case element name.
+	 * @param pos position in html after the element name.
+	 */
+	void
+	end_tag(const string_type& tag_name, const char_type* pos)
+	{
+		parser& p = this->parser_;
+		if (tag_name != p.current_node_->name()
+			&& this->last_element_void_) {
+			this->close_current_node();
+			this->last_element_void_ = false;
+		}
+
+		while (tag_name != p.current_node_->name()
+			&& autoclose_last_child(p.current_node_->name())) {
+			this->close_current_node();
+
+			if (p.stats_) {
+				++p.stats_->implied_end_tags;
+			}
+		}
+
+		const string_type& expected_name = p.current_node_->name();
+		if (expected_name != tag_name && p.fragment_
+			&& p.current_node_ == p.document_) {
+			// End tag of element opened in the previous fragment is
+			// left for stitch_fragment().
+			p.document_->append_child(node_null)->name(tag_name);
+			this->closed_node_ = p.current_node_;
+
+			return;
+		}
+
+		if (expected_name != tag_name) {
+			std::string err_msg = "Expected: '" + expected_name
+				+ "', found: '" + tag_name + "'";
+			throw parse_error(status_end_element_mismatch,
+				this->str_html_, pos, err_msg);
+		}
+
+		this->closed_node_ = p.current_node_;
+		if (p.current_node_->parent()) {
+			this->close_current_node();
+			this->last_element_void_ = false;
+		}
+	}
+
+	/**
+	 * Appends text node.
+	 */
+	void
+	text(string_type&& pcdata)
+	{
+		if (this->last_element_void_) {
+			this->close_current_node();
+			this->last_element_void_ = false;
+		}
+
+		parser& p = this->parser_;
+		if (p.stats_) {
+			++p.stats_->text_nodes;
+			count_object_allocations<cpphtml::node>(*p.stats_);
+			count_string_allocation(*p.stats_, pcdata.size());
+		}
+
+		p.count_node();
+		p.current_node_->append_child(node_cdata)->value(
+			std::move(pcdata));
+	}
+
+	/**
+	 * Appends content of raw text or RCDATA element.
+	 */
+	void
+	raw_text(string_type&& raw_text)
+	{
+		parser& p = this->parser_;
+		if (p.stats_) {
+			++p.stats_->text_nodes;
+			p.stats_->raw_text_bytes += raw_text.size();
+			count_object_allocations<cpphtml::node>(*p.stats_);
+			count_string_allocation(*p.stats_, raw_text.size());
+		}
+
+		p.count_node();
+		p.current_node_->append_child(node_cdata)->value(
+			std::move(raw_text));
+	}
+
+	/**
+	 * Appends comment, CDATA section or doctype node.
+	 */
+	void
+	special_node(node_type type, string_type&& value)
+	{
+		parser& p = this->parser_;
+		p.count_node();
+
+		if (p.stats_ && type == node_cdata) {
+			++p.stats_->text_nodes;
+			count_object_allocations<cpphtml::node>(*p.stats_);
+			count_string_allocation(*p.stats_, value.size());
+		}
+
+		p.current_node_->append_child(type)->value(std::move(value));
+	}
+
+	/**
+	 * Stops building, if stop condition is satisfied by the start tag
+	 * or end tag reported last.
+	 */
+	void
+	check_stop_condition(parse_event event)
+	{
+		parser& p = this->parser_;
+		const std::shared_ptr<node>& event_node = event == event_start_tag
+			? p.current_node_ : this->closed_node_;
+
+		if (p.stop_condition_ && p.stop_condition_(event, event_node)) {
+			this->stopped_ = true;
+			p.status_ = status_stopped;
+		}
+	}
+
+	/**
+	 * @return true if stop condition was satisfied.
+	 */
+	bool
+	stopped() const
+	{
+		return this->stopped_;
+	}
+
+	/**
+	 * Closes void element left open at the end of html.
+	 */
+	void
+	finish()
+	{
+		if (this->last_element_void_) {
+			this->close_current_node();
+			this->last_element_void_ = false;
+		}
+	}
+
+private:
+	parser& parser_;
+	const string_type& str_html_;
+
+	// Flag indicating if last parsed tag is void html element.
+	bool last_element_void_ = false;
+	// Number of attributes of the last parsed start tag.
+	std::size_t attribute_count_ = 0;
+	// Element closed by the last end tag.
+	std::shared_ptr<node> closed_node_;
+	// Flag indicating if stop condition was satisfied.
+	bool stopped_ = false;
+
+	/**
+	 * Moves to the parent of the current node.
+	 */
+	void
+	close_current_node()
+	{
+		this->parser_.current_node_ = this->parser_.current_node_->parent();
+		--this->parser_.depth_;
+	}
+};
+
+
+template <typename Builder> const char_type*
+parser::scan_exclamation(const char_type* s, char_type endch,
+	Builder& builder)
+{
+	// Skip '<!'.
+	s += 2;
+
+	// '<!-...' - comment.
+	if (*s == '-') {
+		++s;
+		if (*s != '-') {
+			THROW_ERROR(status_bad_comment, s);
+		}
+
+		++s;
+		const char_type* comment_start = s;
+
+		// Scan for terminating '-->'.
+		SCANFOR(s[0] == '-' && s[1] == '-'
+			&& ENDSWITH(s[2], '>'));
+		CHECK_ERROR(status_bad_comment, s);
+
+		if (this->option_set(parse_comments)) {
+			// TODO(povilas): if this->option_set(parse_eol),
+			// replace \r\n to \n.
+			size_t comment_len = (s - 1) - comment_start + 1;
+			this->check_limit(comment_len, this->limits_.max_text_length,
+				status_text_limit_exceeded);
+
+			builder.special_node(node_comment,
+				string_type(comment_start, comment_len));
+		}
+
+		// Step over the '\0->'.
+		s += (s[2] == '>' ? 3 : 2);
+	}
+	// '<![CDATA[...'
+	else if (*s == '[') {
+		if (!(*++s=='C' && *++s=='D' && *++s=='A' && *++s=='T'
+			&& *++s=='A' && *++s == '[')) {
+			THROW_ERROR(status_bad_cdata, s);
+		}
+
+		++s;
+		const char_type* cdata_start = s;
+
+		SCANFOR(s[0] == ']' && s[1] == ']'
+			&& ENDSWITH(s[2], '>'));
+		CHECK_ERROR(status_bad_cdata, s);
+
+		if (this->option_set(parse_cdata)) {
+			// TODO(povilas): if this->option_set(parse_eol),
+			// replace \r\n to \n.
+			size_t cdata_len = s - cdata_start + 1;
+			this->check_limit(cdata_len, this->limits_.max_text_length,
+				status_text_limit_exceeded);
+
+			builder.special_node(node_cdata,
+				string_type(cdata_start, cdata_len));
+		}
+
+		++s;
+		s += (s[1] == '>' ? 2 : 1); // Step over the last ']>'.
+	}
+	// <!DOCTYPE
+	else if (s[0] == 'D' && s[1] == 'O' && s[2] == 'C' && s[3] == 'T'
+		&& s[4] == 'Y' && s[5] == 'P' && ENDSWITH(s[6], 'E')) {
+		s -= 2;
+
+		const char_type* doctype_start = s + 9;
+
+		s = advance_doctype_group(s, endch);
+
+		if (this->option_set(parse_doctype)) {
+			while (is_chartype(*doctype_start, ct_space)) {
+				++doctype_start;
+			}
+
+			assert(s[-1] == '>');
+			size_t doctype_len = (s - 2) - doctype_start + 1;
+
+			builder.special_node(node_doctype,
+				string_type(doctype_start, doctype_len));
+		}
+	}
+	else if (*s == 0 && endch == '-') THROW_ERROR(status_bad_comment, s);
+	else if (*s == 0 && endch == '[') THROW_ERROR(status_bad_cdata, s);
+	else THROW_ERROR(status_unrecognized_tag, s);
+
+	return s;
+}
+
+
+const char_type*
+parser::parse_exclamation(const char_type* s, char_type endch)
+{
+	// Exclamation markup creates no elements, so html string isn't needed
+	// for error messages.
+	string_type no_html;
+	tree_builder builder(*this, no_html);
+
+	try {
+		return this->scan_exclamation(s, endch, builder);
+	}
+	catch (const parse_error& e) {
+		this->status_ = e.status();
+		throw;
+	}
+}
+
+
+void
+parser::parse_attributes(const string_type& raw_attributes, node& element)
+{
+	const char_type* s = raw_attributes.c_str();
+	string_type attr_name;
+
+	while (true) {
+		s = skip_white_spaces(s);
+		if (*s == '\0') {
+			break;
+		}
+
+		// Skip '/' of self-closing tag and malformed markup.
+		if (!is_chartype(*s, ct_start_symbol)) {
+			++s;
+			continue;
+		}
+
+		const char_type* attr_name_start = s;
+		s = scan_name(s, attr_name);
+		s = skip_white_spaces(s);
+
+		string_type attr_val;
+		if (*s == '=') {
+			++s;
+			s = skip_white_spaces(s);
+
+			if (*s == '"' || *s == '\'') {
+				char_type quote_symbol = *s++;
+				const char_type* attr_val_start = s;
+				while (*s && *s != quote_symbol) {
+					++s;
+				}
+				attr_val.assign(attr_val_start, s);
+
+				if (*s) {
+					++s;
+				}
+			}
+			else {
+				const char_type* attr_val_start = s;
+				while (!is_chartype(*s, ct_parse_attr)) {
+					++s;
+				}
+				attr_val.assign(attr_val_start, s);
+			}
+		}
+
+		auto& attr = element.add_attribute(attr_name,
+			std::move(attr_val));
+		if (spelled_differently(attr_name, attr_name_start)) {
+			attr.source_name(string_type(attr_name_start,
+				attr_name.size()));
+		}
+	}
+}
+
+
+template <typename Builder> void
+parser::scan(const string_type& str_html, Builder& builder)
+{
+	typedef std::chrono::steady_clock clock;
+
+	const char_type* s = str_html.c_str();
+	const char_type* s_end = s + str_html.size();
+
+	// Attribute limits are checked only when attributes are parsed.
+	bool lazy_attributes = this->option_set(parse_lazy_attributes)
+		&& this->limits_.max_attributes == 0
+		&& this->limits_.max_text_length == 0;
+
+	// Flag indicating if the start tag being scanned is void element.
+	bool void_element = false;
+
+	// Skips the rest of the start tag and, in skip filter mode, the whole
+	// element subtree.
+	auto skip_element = [&](const string_type& tag_name,
+		unsigned int tag_flags) {
+
+		bool self_closing = false;
+		s = skip_start_tag_rest(s, s_end, self_closing);
+		if (self_closing || (tag_flags & ef_void)) {
+			return;
+		}
+
+		if (tag_flags & (ef_raw_text | ef_rcdata)) {
+			s = skip_past(find_raw_text_end(s, s_end, tag_name), s_end,
+				'>');
+		}
+		else if (this->filter_mode_ == filter_skip) {
+			s = skip_element_content(s, s_end, tag_name,
+				this->skipped_elements_, this->name_buffer_);
+		}
+	};
+
+	auto parse_pcdata = [&]() {
+		const char_type* pcdata_start = s;
+		bool whitespace_only = false;
+		s = scan_pcdata(s, s_end, whitespace_only);
+
+		if ((whitespace_only && !this->option_set(parse_ws_pcdata))
+			|| builder.outside_kept_elements()) {
+			return;
+		}
+
+		size_t pcdata_len = (s - 1) - pcdata_start + 1;
+		this->check_limit(pcdata_len, this->limits_.max_text_length,
+			status_text_limit_exceeded);
+		builder.text(string_type(pcdata_start, pcdata_len));
+	};
+
+	// Parses the content of raw text or RCDATA element up to its end tag.
+	auto parse_raw_text = [&](const string_type& tag_name) {
+		clock::time_point raw_text_start_time;
+		if (this->stats_) {
+			raw_text_start_time = clock::now();
+		}
+
+		const char_type* raw_text_start = s;
+		s = find_raw_text_end(s, s_end, tag_name);
+
+		if (s != raw_text_start) {
+			this->check_limit(s - raw_text_start,
+				this->limits_.max_text_length,
+				status_text_limit_exceeded);
+			builder.raw_text(string_type(raw_text_start,
+				s - raw_text_start));
+		}
+
+		if (this->stats_) {
+			this->stats_->raw_text_time += clock::now()
+				- raw_text_start_time;
+		}
+	};
+
+	auto on_attribute_name_state = [&]() {
+		const char_type* attr_name_start = s;
+
+		string_type& attr_name = this->attribute_name_buffer_;
+		s = scan_name(s, attr_name);
+		if (*s == '\0') {
+			throw parse_error(status_bad_attribute, str_html, s);
+		}
+
+		s = skip_white_spaces(s);
+		if (*s == '\0') {
+			throw parse_error(status_bad_attribute, str_html, s);
+		}
+
+		string_type attr_val;
+		// Attribute with value.
+		if (*s == '=') {
+			++s;
+			s = skip_white_spaces(s);
 
 			char_type quote_symbol = 0;
 			if (*s == '"' || *s == '\'') {
@@ -541,6 +1369,9 @@ parser::parse(const string_type& str_html)
 			}
 
 			size_t attr_val_len = (s - 1) - attr_val_start + 1;
+			this->check_limit(attr_val_len,
+				this->limits_.max_text_length,
+				status_text_limit_exceeded);
 			attr_val = string_type(attr_val_start, attr_val_len);
 
 			if (quote_symbol) {
@@ -559,7 +1390,7 @@ parser::parse(const string_type& str_html)
 			}
 		}
 
-		on_attribute(attr_name, attr_val);
+		builder.attribute(attr_name, attr_name_start, std::move(attr_val));
 	};
 
 	auto on_self_closing_start_tag_state = [&]() {
@@ -568,118 +1399,827 @@ parser::parse(const string_type& str_html)
 		if (*s != '>') {
 			throw parse_error(status_bad_start_element, str_html, s);
 		}
-		else {
-			last_element_void = true;
+		else {
+			void_element = true;
+		}
+	};
+
+	auto on_tag_open_state = [&]() {
+		++s;
+
+		// Check if the current character is a tag start symbol.
+		if (is_chartype(*s, ct_start_symbol)) {
+			const char_type* tag_name_start = s;
+
+			// Scan while the current character is a symbol belonging
+			// to the set of symbols acceptable within a tag. In other
+			// words, scan until the termination symbol is discovered.
+			string_type& tag_name = this->tag_name_buffer_;
+			s = scan_name(s, tag_name);
+			unsigned int tag_flags = element_flags(tag_name);
+
+			if (!builder.build_element(tag_name)) {
+				skip_element(tag_name, tag_flags);
+				return;
+			}
+
+			builder.start_tag(tag_name, tag_name_start);
+			void_element = false;
+
+			// End of tag.
+			if (*s == '>') {
+				void_element = tag_flags & ef_void;
+			}
+			// Attributes are copied to be parsed on first access.
+			else if (lazy_attributes && *s != '/') {
+				const char_type* attributes_start = s;
+				bool self_closing = false;
+				s = skip_start_tag_rest(s, s_end, self_closing);
+				if (s[-1] != '>') {
+					throw parse_error(status_bad_start_element,
+						str_html, s);
+				}
+
+				// Step back to '>'.
+				--s;
+				builder.raw_attributes(attributes_start, s);
+				void_element = (tag_flags & ef_void)
+					|| (self_closing && !ends_unquoted_value(
+					attributes_start, s - 1));
+			}
+			else if (is_chartype(*s, ct_space)) {
+				while (true) {
+					s = skip_white_spaces(s);
+
+					// Attribute start.
+					if (is_chartype(*s, ct_start_symbol)) {
+						on_attribute_name_state();
+					}
+					// Void element end.
+					else if (*s == '/') {
+						on_self_closing_start_tag_state();
+						break;
+					}
+					// Tag end, also might be void element.
+					else if (*s == '>') {
+						void_element = tag_flags & ef_void;
+						break;
+					}
+					else {
+						throw parse_error(status_bad_start_element, str_html, s);
+					}
+				} // while
+			}
+			// Void HTML element.
+			else if (*s == '/') {
+				on_self_closing_start_tag_state();
+			}
+			else {
+				throw parse_error(status_bad_start_element, str_html, s);
+			}
+
+			++s;
+			builder.start_tag_end(void_element);
+
+			if (this->stats_ && void_element) {
+				++this->stats_->void_elements;
+			}
+
+			if (!void_element
+				&& (tag_flags & (ef_raw_text | ef_rcdata))) {
+				parse_raw_text(tag_name);
+			}
+
+			builder.check_stop_condition(event_start_tag);
+		}
+		// Closing tag, e.g. </hmtl>
+		else if (*s == '/') {
+			++s;
+
+			string_type& tag_name = this->tag_name_buffer_;
+			s = scan_name(s, tag_name);
+
+			if (builder.closes_filtered_element(tag_name)) {
+				s = skip_past(s, s_end, '>');
+				return;
+			}
+
+			builder.end_tag(tag_name, s);
+
+			s = skip_white_spaces(s);
+			if (*s != '>') {
+				THROW_ERROR(status_bad_end_element, "");
+			}
+
+			++s;
+
+			builder.check_stop_condition(event_end_tag);
+		}
+		// Comment: <!-- ...
+		else if (*s == '!') {
+			s = this->scan_exclamation(s - 1, '>', builder);
+		}
+		else {
+			throw parse_error(status_unrecognized_tag,
+				str_html, s);
+		}
+	};
+
+	// Parse while the current character is not '\0'.
+	if (this->stats_ == nullptr) {
+		while (*s != '\0' && !builder.stopped()) {
+			// Check if the current character is the start tag
+			// character
+			if (*s == '<') {
+				on_tag_open_state();
+			}
+			else {
+				parse_pcdata();
+			}
+		}
+	}
+	else {
+		// Same loop timing the parsing phases.
+		while (*s != '\0' && !builder.stopped()) {
+			auto token_start = clock::now();
+			if (*s == '<') {
+				auto raw_text_time = this->stats_->raw_text_time;
+				on_tag_open_state();
+				this->stats_->tag_time += clock::now() - token_start
+					- (this->stats_->raw_text_time - raw_text_time);
+			}
+			else {
+				parse_pcdata();
+				this->stats_->text_time += clock::now() - token_start;
+			}
+		}
+
+		this->stats_->bytes_scanned = s - str_html.c_str();
+	}
+}
+
+
+std::shared_ptr<document>
+parser::parse(const string_type& str_html)
+{
+	typedef std::chrono::steady_clock clock;
+
+	this->status_ = status_ok;
+	this->node_count_ = 0;
+	this->depth_ = 0;
+
+	clock::time_point parse_start;
+	if (this->stats_) {
+		*this->stats_ = parse_stats();
+		parse_start = clock::now();
+	}
+
+	if (str_html.size() == 0) {
+		return this->document_;
+	}
+
+	try {
+		this->check_limit(str_html.size(), this->limits_.max_input_size,
+			status_input_too_large);
+
+		this->current_node_ = this->document_;
+		this->depth_ = 0;
+
+		tree_builder builder(*this, str_html);
+		this->scan(str_html, builder);
+		builder.finish();
+	}
+	catch (const parse_error& e) {
+		this->status_ = e.status();
+		throw;
+	}
+
+	if (this->stats_) {
+		this->stats_->total_time = clock::now() - parse_start;
+	}
+
+	return this->document_;
+}
+
+
+/**
+ * Finds positions where html can be split into chunks which are parsed
+ * independently. Those are starts of tags which are not inside other tags,
+ * comments or raw text elements. Html is pre-scanned sequentially, but only
+ * tags are looked at.
+ *
+ * @param chunk_count preferred chunk count.
+ * @param name scratch buffer for scanned tag names.
+ * @return split positions in ascending order. There are at most
+ *	chunk_count - 1 of them.
+ */
+std::vector<const char_type*>
+find_split_points(const char_type* s, const char_type* end,
+	std::size_t chunk_count, string_type& name)
+{
+	static const char_type comment_end[] = {'-', '-', '>'};
+	static const char_type cdata_start[] = {'[', 'C', 'D', 'A', 'T', 'A',
+		'['};
+	static const char_type cdata_end[] = {']', ']', '>'};
+
+	std::vector<const char_type*> split_points;
+	const std::size_t chunk_size = (end - s) / chunk_count;
+	const char_type* next_split = s + chunk_size;
+
+	while (split_points.size() + 1 < chunk_count) {
+		const char_type* tag_start =
+			std::char_traits<char_type>::find(s, end - s, '<');
+		if (tag_start == nullptr) {
+			break;
+		}
+
+		s = tag_start + 1;
+
+		// Comment, CDATA section or doctype.
+		if (*s == '!') {
+			if (s[1] == '-' && s[2] == '-') {
+				s = std::search(s + 3, end, comment_end,
+					comment_end + 3);
+				s = s != end ? s + 3 : end;
+			}
+			// CDATA section may contain markup, e.g. "a > <b>".
+			else if (end - s > 8 && std::equal(cdata_start,
+				cdata_start + 7, s + 1)) {
+				s = std::search(s + 8, end, cdata_end,
+					cdata_end + 3);
+				s = s != end ? s + 3 : end;
+			}
+			else {
+				s = skip_past(s, end, '>');
+			}
+
+			continue;
+		}
+
+		if (*s != '/' && !is_chartype(*s, ct_start_symbol)) {
+			continue;
+		}
+
+		if (tag_start >= next_split) {
+			split_points.push_back(tag_start);
+			next_split = tag_start + chunk_size;
+		}
+
+		// End tag.
+		if (*s == '/') {
+			s = skip_past(s, end, '>');
+			continue;
 		}
-	};
 
-	auto on_tag_open_state = [&]() {
-		++s;
+		// Start tag.
+		s = scan_name(s, name);
 
-		// Check if the current character is a tag start symbol.
-		if (is_chartype(*s, ct_start_symbol)) {
-			const char_type* tag_name_start = s;
+		bool self_closing = false;
+		s = skip_start_tag_rest(s, end, self_closing);
 
-			// Scan while the current character is a symbol belonging
-			// to the set of symbols acceptable within a tag. In other
-			// words, scan until the termination symbol is discovered.
-			SCANWHILE(is_chartype(*s, ct_symbol));
+		if (!self_closing
+			&& (element_flags(name) & (ef_raw_text | ef_rcdata))) {
+			// Points to the end tag of raw text element.
+			s = find_raw_text_end(s, end, name);
+		}
+	}
 
-			size_t tag_name_len = (s - 1) - tag_name_start
-				+ 1;
-			string_type tag_name = string_type(
-				tag_name_start, tag_name_len);
-			str_toupper(tag_name);
+	return split_points;
+}
 
-			on_tag_start(tag_name);
 
-			// End of tag.
-			if (*s == '>') {
-				last_element_void = is_void_element(this->current_node_->name());
-			}
-			else if (is_chartype(*s, ct_space)) {
-				while (true) {
-					s = skip_white_spaces(s);
+/**
+ * Moves nodes of html fragment, which was parsed separately, to the open
+ * elements of the document. End tags and implied end tags in the fragment
+ * close the open elements the same way as if the document was parsed
+ * sequentially.
+ *
+ * @param fragment document built from html fragment.
+ * @param open_node node which was left open at the end of fragment.
+ * @param open_elements stack of the open document elements. It's updated
+ *	with the elements left open at the end of fragment.
+ * @throws parse_error on end tag which does not match any open element.
+ */
+void
+stitch_fragment(const std::shared_ptr<document>& fragment,
+	std::shared_ptr<node> open_node,
+	std::vector<std::shared_ptr<node> >& open_elements)
+{
+	std::vector<std::shared_ptr<node> > fragment_open_elements;
+	for (; open_node != fragment; open_node = open_node->parent()) {
+		fragment_open_elements.push_back(open_node);
+	}
 
-					// Attribute start.
-					if (is_chartype(*s, ct_start_symbol)) {
-						on_attribute_name_state();
-					}
-					// Void element end.
-					else if (*s == '/') {
-						on_self_closing_start_tag_state();
-						break;
-					}
-					// Tag end, also might be void element.
-					else if (*s == '>') {
-						last_element_void = is_void_element(this->current_node_->name());
-						break;
-					}
-					else {
-						throw parse_error(status_bad_start_element, str_html, s);
-					}
-				} // while
+	// Children are moved out of fragment, so the next one is taken before.
+	node_ref next_child;
+	for (node_ref child = fragment->ref().first_child(); child;
+		child = next_child) {
+		next_child = child.next_sibling();
+
+		// End tag of element opened in the previous fragments.
+		if (child->type() == node_null) {
+			const string_type& tag_name = child->name();
+			if (element_flags(tag_name) & ef_void) {
+				continue;
 			}
-			// Void HTML element.
-			else if (*s == '/') {
-				on_self_closing_start_tag_state();
+
+			while (open_elements.size() > 1
+				&& open_elements.back()->name() != tag_name
+				&& autoclose_last_child(
+				open_elements.back()->name())) {
+				open_elements.pop_back();
 			}
-			else {
-				throw parse_error(status_bad_start_element, str_html, s);
+
+			if (open_elements.size() == 1
+				|| open_elements.back()->name() != tag_name) {
+				throw parse_error(status_end_element_mismatch);
 			}
 
-			++s;
+			open_elements.pop_back();
+			continue;
 		}
-		// Closing tag, e.g. </hmtl>
-		else if (*s == '/') {
-			++s;
 
-			const char_type* tag_name_start = s;
-			while (is_chartype(*s, ct_symbol)) {
-				++s;
+		if (child->type() == node_element) {
+			while (open_elements.size() > 1 && autoclose_prev_sibling(
+				child->name(), open_elements.back()->name())) {
+				open_elements.pop_back();
 			}
+		}
 
-			size_t tag_name_len = (s - 1) - tag_name_start
-				+ 1;
-			string_type tag_name = string_type(tag_name_start,
-				tag_name_len);
-			str_toupper(tag_name);
+		open_elements.back()->append_child(child.lock());
+	}
 
-			on_closing_tag(tag_name);
+	open_elements.insert(std::end(open_elements),
+		fragment_open_elements.rbegin(), fragment_open_elements.rend());
+}
 
-			s = skip_white_spaces(s);
-			if (*s != '>') {
-				THROW_ERROR(status_bad_end_element, "");
-			}
 
-			++s;
-		}
-		// Comment: <!-- ...
-		else if (*s == '!') {
-			s = parse_exclamation(s - 1);
+std::shared_ptr<document>
+parser::parse_parallel(const string_type& str_html, std::size_t thread_count)
+{
+	// Smaller inputs are not worth splitting.
+	static const std::size_t min_chunk_size = 64 * 1024;
+
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	thread_count = std::min(thread_count,
+		str_html.size() / min_chunk_size);
+
+	// Elements filter, stop condition, limits and statistics depend on
+	// the whole document state.
+	if (thread_count < 2 || this->filter_mode_ != filter_none
+		|| this->stop_condition_ || this->limits_.max_depth != 0
+		|| this->limits_.max_nodes != 0
+		|| this->limits_.max_attributes != 0
+		|| this->limits_.max_text_length != 0 || this->stats_) {
+		return this->parse(str_html);
+	}
+
+	this->status_ = status_ok;
+	try {
+		this->check_limit(str_html.size(),
+			this->limits_.max_input_size, status_input_too_large);
+	}
+	catch (const parse_error& e) {
+		this->status_ = e.status();
+		throw;
+	}
+
+	const char_type* s = str_html.c_str();
+	const char_type* s_end = s + str_html.size();
+
+	std::vector<const char_type*> chunk_bounds = find_split_points(s,
+		s_end, thread_count, this->name_buffer_);
+	chunk_bounds.insert(std::begin(chunk_bounds), s);
+	chunk_bounds.push_back(s_end);
+
+	const std::size_t chunk_count = chunk_bounds.size() - 1;
+	std::vector<std::shared_ptr<document> > fragments(chunk_count);
+	std::vector<std::shared_ptr<node> > open_nodes(chunk_count);
+	std::vector<std::exception_ptr> errors(chunk_count);
+
+	auto parse_chunk = [&](std::size_t i) {
+		try {
+			parser chunk_parser(this->options_);
+			chunk_parser.fragment_ = true;
+
+			fragments[i] = chunk_parser.parse(string_type(
+				chunk_bounds[i], chunk_bounds[i + 1]));
+			open_nodes[i] = chunk_parser.current_node_;
 		}
-		else {
-			throw parse_error(status_unrecognized_tag,
-				str_html, s);
+		catch (...) {
+			errors[i] = std::current_exception();
 		}
 	};
 
+	std::vector<std::thread> threads;
+	for (std::size_t i = 1; i < chunk_count; ++i) {
+		threads.emplace_back(parse_chunk, i);
+	}
+	parse_chunk(0);
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	try {
+		for (auto& error : errors) {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+
+		std::vector<std::shared_ptr<node> > open_elements{
+			this->document_};
+		for (std::size_t i = 0; i < chunk_count; ++i) {
+			stitch_fragment(fragments[i], open_nodes[i],
+				open_elements);
+		}
+	}
+	catch (const parse_error& e) {
+		this->status_ = e.status();
+		throw;
+	}
+
 	this->current_node_ = this->document_;
+	this->depth_ = 0;
 
-	// Parse while the current character is not '\0'.
-	while (*s != '\0') {
-		// Check if the current character is the start tag character
-		if (*s == '<') {
-			on_tag_open_state();
+	return this->document_;
+}
+
+
+/**
+ * Bounded queue passing batches of values from a single producer thread to
+ * a single consumer thread. Batches are allocated once and reused, so
+ * values keep their buffers, and threads synchronize only once per batch.
+ * Thread waiting for the other one is blocked, not spinning.
+ */
+template <typename T>
+class batch_queue {
+public:
+	batch_queue(std::size_t batch_count, std::size_t batch_size)
+		: batches_(batch_count, std::vector<T>(batch_size)),
+		sizes_(batch_count, 0)
+	{
+	}
+
+	/**
+	 * @return batch filled by producer. Its size never changes.
+	 */
+	std::vector<T>&
+	back()
+	{
+		return this->batches_[this->tail_ % this->batches_.size()];
+	}
+
+	/**
+	 * Passes the first size values of the back() batch to consumer and
+	 * waits until the next batch is free. Doesn't wait after consumer
+	 * cancelled the queue.
+	 */
+	void
+	push(std::size_t size)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex_);
+		this->sizes_[this->tail_ % this->batches_.size()] = size;
+		++this->tail_;
+		this->pushed_.notify_one();
+		this->popped_.wait(lock, [this]() {
+			return this->tail_ - this->head_ < this->batches_.size()
+				|| this->cancelled_;
+		});
+	}
+
+	/**
+	 * Waits until producer pushes a batch.
+	 *
+	 * @param[out] size count of values in the batch.
+	 * @return the first pushed batch, which is kept until pop().
+	 */
+	std::vector<T>&
+	front(std::size_t& size)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex_);
+		this->pushed_.wait(lock, [this]() {
+			return this->head_ != this->tail_;
+		});
+
+		std::size_t index = this->head_ % this->batches_.size();
+		size = this->sizes_[index];
+		return this->batches_[index];
+	}
+
+	/**
+	 * Returns the front() batch to producer.
+	 */
+	void
+	pop()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		++this->head_;
+		this->popped_.notify_one();
+	}
+
+	/**
+	 * Makes producer stop waiting for consumer, which failed.
+	 */
+	void
+	cancel()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		this->cancelled_ = true;
+		this->popped_.notify_one();
+	}
+
+	bool cancelled() const { return this->cancelled_; }
+
+private:
+	std::vector<std::vector<T> > batches_;
+	std::vector<std::size_t> sizes_;
+
+	std::mutex mutex_;
+	std::condition_variable pushed_;
+	std::condition_variable popped_;
+	// Producer reads its own position without locking.
+	std::size_t head_ = 0;
+	std::size_t tail_ = 0;
+	std::atomic<bool> cancelled_{false};
+};
+
+
+enum markup_event_type {
+	markup_start_tag,
+	markup_attribute,
+	markup_raw_attributes,
+	markup_start_tag_end,
+	markup_end_tag,
+	markup_text,
+	markup_raw_text,
+	markup_special_node,
+	// Html is scanned or scanner failed.
+	markup_end
+};
+
+
+/**
+ * Markup reported by parser::scan(), which parse_pipelined() passes from
+ * the scanner thread to the tree builder.
+ */
+struct markup_event {
+	markup_event_type type = markup_end;
+	// Type of special node, e.g. comment.
+	node_type special_node_type = node_null;
+	bool void_element = false;
+	// Upper case element or attribute name.
+	string_type name;
+	// Text or attribute value.
+	string_type value;
+	// Element or attribute name in html, raw attributes start or end tag
+	// position.
+	const char_type* position = nullptr;
+	// Raw attributes end.
+	const char_type* end = nullptr;
+};
+
+
+/**
+ * Builder used by parse_pipelined() on the scanner thread. Instead of
+ * building the tree it writes markup events for tree_builder into batches.
+ * Events are reused, so names are copied into existing buffers and texts
+ * are moved. Elements filter and stop condition are not supported, so they
+ * are never applied.
+ */
+class markup_event_writer {
+public:
+	markup_event_writer(batch_queue<markup_event>& events)
+		: events_(events), batch_(&events.back())
+	{
+	}
+
+	bool outside_kept_elements() const { return false; }
+	bool build_element(const string_type&) const { return true; }
+	bool closes_filtered_element(const string_type&) { return false; }
+	void check_stop_condition(parse_event) {}
+
+	/**
+	 * @return true if tree builder failed, so scanning should stop.
+	 */
+	bool stopped() const { return this->events_.cancelled(); }
+
+	void
+	start_tag(const string_type& tag_name, const char_type* tag_name_start)
+	{
+		markup_event& event = this->next(markup_start_tag);
+		event.name = tag_name;
+		event.position = tag_name_start;
+	}
+
+	void
+	attribute(const string_type& attr_name,
+		const char_type* attr_name_start, string_type&& attr_val)
+	{
+		markup_event& event = this->next(markup_attribute);
+		event.name = attr_name;
+		event.value = std::move(attr_val);
+		event.position = attr_name_start;
+	}
+
+	void
+	raw_attributes(const char_type* start, const char_type* end)
+	{
+		markup_event& event = this->next(markup_raw_attributes);
+		event.position = start;
+		event.end = end;
+	}
+
+	void
+	start_tag_end(bool void_element)
+	{
+		this->next(markup_start_tag_end).void_element = void_element;
+	}
+
+	void
+	end_tag(const string_type& tag_name, const char_type* pos)
+	{
+		markup_event& event = this->next(markup_end_tag);
+		event.name = tag_name;
+		event.position = pos;
+	}
+
+	void
+	text(string_type&& pcdata)
+	{
+		this->next(markup_text).value = std::move(pcdata);
+	}
+
+	void
+	raw_text(string_type&& raw_text)
+	{
+		this->next(markup_raw_text).value = std::move(raw_text);
+	}
+
+	void
+	special_node(node_type type, string_type&& value)
+	{
+		markup_event& event = this->next(markup_special_node);
+		event.special_node_type = type;
+		event.value = std::move(value);
+	}
+
+	/**
+	 * Reports the end of html. Called after scanner failed as well.
+	 */
+	void
+	end()
+	{
+		this->next(markup_end);
+		this->events_.push(this->size_);
+	}
+
+private:
+	batch_queue<markup_event>& events_;
+	std::vector<markup_event>* batch_;
+	std::size_t size_ = 0;
+
+	/**
+	 * @return event of the specified type to fill. Full batch is passed
+	 *	to tree builder first.
+	 */
+	markup_event&
+	next(markup_event_type type)
+	{
+		if (this->size_ == this->batch_->size()) {
+			this->events_.push(this->size_);
+			this->batch_ = &this->events_.back();
+			this->size_ = 0;
 		}
-		else {
-			if (this->current_node_->name() == "SCRIPT") {
-				parse_script();
+
+		markup_event& event = (*this->batch_)[this->size_++];
+		event.type = type;
+		return event;
+	}
+};
+
+
+std::shared_ptr<document>
+parser::parse_pipelined(const string_type& str_html)
+{
+	// Markup events buffered between scanner and tree builder threads.
+	static const std::size_t event_batch_count = 4;
+	static const std::size_t event_batch_size = 1024;
+
+	// Elements filter and stop condition depend on the tree built so far,
+	// statistics time the parsing phases.
+	if (this->filter_mode_ != filter_none || this->stop_condition_
+		|| this->stats_) {
+		return this->parse(str_html);
+	}
+
+	this->status_ = status_ok;
+	this->node_count_ = 0;
+	this->depth_ = 0;
+
+	if (str_html.size() == 0) {
+		return this->document_;
+	}
+
+	try {
+		this->check_limit(str_html.size(), this->limits_.max_input_size,
+			status_input_too_large);
+
+		this->current_node_ = this->document_;
+		this->depth_ = 0;
+
+		batch_queue<markup_event> events(event_batch_count,
+			event_batch_size);
+		std::exception_ptr scanner_error;
+
+		// Scanner thread touches only scanner state of the parser:
+		// options, limits and scratch buffers.
+		std::thread scanner_thread([&]() {
+			markup_event_writer writer(events);
+			try {
+				this->scan(str_html, writer);
 			}
-			else {
-				parse_pcdata();
+			catch (...) {
+				scanner_error = std::current_exception();
+			}
+			writer.end();
+		});
+
+		tree_builder builder(*this, str_html);
+		try {
+			// Returns true at the end of html.
+			auto build_markup = [&builder](markup_event& event) {
+				switch (event.type) {
+				case markup_start_tag:
+					builder.start_tag(event.name, event.position);
+					break;
+
+				case markup_attribute:
+					builder.attribute(event.name, event.position,
+						std::move(event.value));
+					break;
+
+				case markup_raw_attributes:
+					builder.raw_attributes(event.position, event.end);
+					break;
+
+				case markup_start_tag_end:
+					builder.start_tag_end(event.void_element);
+					break;
+
+				case markup_end_tag:
+					builder.end_tag(event.name, event.position);
+					break;
+
+				case markup_text:
+					builder.text(std::move(event.value));
+					break;
+
+				case markup_raw_text:
+					builder.raw_text(std::move(event.value));
+					break;
+
+				case markup_special_node:
+					builder.special_node(event.special_node_type,
+						std::move(event.value));
+					break;
+
+				case markup_end:
+					return true;
+				}
+
+				return false;
+			};
+
+			bool ended = false;
+			while (!ended) {
+				std::size_t size;
+				auto& batch = events.front(size);
+				for (std::size_t i = 0; i < size && !ended; ++i) {
+					ended = build_markup(batch[i]);
+				}
+				events.pop();
 			}
 		}
+		catch (...) {
+			events.cancel();
+			scanner_thread.join();
+			throw;
+		}
+
+		scanner_thread.join();
+		if (scanner_error) {
+			std::rethrow_exception(scanner_error);
+		}
+
+		builder.finish();
+	}
+	catch (const parse_error& e) {
+		this->status_ = e.status();
+		throw;
 	}
 
 	return this->document_;
@@ -744,6 +2284,24 @@ parser::status_description(parse_status status)
 	case status_end_element_mismatch:
 		return "Start-end tags mismatch.";
 
+	case status_stopped:
+		return "Parsing was stopped by the stop condition.";
+
+	case status_input_too_large:
+		return "Input exceeds the maximum size.";
+
+	case status_depth_limit_exceeded:
+		return "Elements nesting exceeds the maximum depth.";
+
+	case status_node_limit_exceeded:
+		return "Document exceeds the maximum node count.";
+
+	case status_attribute_limit_exceeded:
+		return "Element exceeds the maximum attribute count.";
+
+	case status_text_limit_exceeded:
+		return "Text exceeds the maximum length.";
+
 	default:
 		return "Unknown error.";
 	}
@@ -757,6 +2315,71 @@ parser::get_document() const
 }
 
 
+void
+parser::stop_when(parse_stop_condition condition)
+{
+	this->stop_condition_ = condition;
+}
+
+
+void
+parser::stop_after_end_tag(const string_type& tag_name)
+{
+	string_type stop_tag_name = tag_name;
+	str_toupper(stop_tag_name);
+
+	this->stop_condition_ = [stop_tag_name](parse_event event,
+		const std::shared_ptr<node>& event_node) {
+		return event == event_end_tag
+			&& event_node->name() == stop_tag_name;
+	};
+}
+
+
+void
+parser::collect_stats(parse_stats* stats)
+{
+	this->stats_ = stats;
+}
+
+
+void
+parser::limits(const parse_limits& limits)
+{
+	this->limits_ = limits;
+}
+
+
+const parse_limits&
+parser::limits() const
+{
+	return this->limits_;
+}
+
+
+parse_status
+parser::status() const
+{
+	return this->status_;
+}
+
+
+void
+parser::skip_elements(const std::set<string_type>& tag_names)
+{
+	this->filter_mode_ = tag_names.empty() ? filter_none : filter_skip;
+	this->set_filter_elements(tag_names);
+}
+
+
+void
+parser::keep_elements(const std::set<string_type>& tag_names)
+{
+	this->filter_mode_ = filter_keep;
+	this->set_filter_elements(tag_names);
+}
+
+
 // parse_error
 
 parse_error::parse_error(parse_status status)
@@ -823,4 +2446,34 @@ parser::option_set(unsigned int opt)
 	return this->options_ & opt;
 }
 
+
+void
+parser::check_limit(std::size_t value, std::size_t limit,
+	parse_status status)
+{
+	if (limit != 0 && value > limit) {
+		throw parse_error(status);
+	}
+}
+
+
+void
+parser::count_node()
+{
+	this->check_limit(++this->node_count_, this->limits_.max_nodes,
+		status_node_limit_exceeded);
+}
+
+
+void
+parser::set_filter_elements(const std::set<string_type>& tag_names)
+{
+	this->filter_elements_.clear();
+
+	for (auto tag_name : tag_names) {
+		str_toupper(tag_name);
+		this->filter_elements_.insert(tag_name);
+	}
+}
+
 } // cpp-html.
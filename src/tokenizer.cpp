@@ -1,12 +1,21 @@
 #include <string>
-#include <functional>
-#include <map>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <set>
+
+#if defined(__SSE2__) && !defined(PUGIHTML_WCHAR_MODE)
+#include <emmintrin.h>
+#endif
 
 #include <cpp-html/tokenizer.hpp>
 #include <cpp-html/parser.hpp>
 
+#include "named_char_refs.hpp"
+
 
 namespace cpphtml
 {
@@ -46,13 +55,186 @@ const char_type tag_close_char = '>';
 const char_type solidus_char = '/';
 const char_type equals_sign_char = '=';
 
+// U+FFFD REPLACEMENT CHARACTER encoded in UTF-8.
+const char_type replacement_char[] = "\xEF\xBF\xBD";
+
+
+// Elements whose content is not tokenized as markup.
+const std::set<string_type> raw_text_elements = {"script", "style", "xmp",
+	"iframe", "noembed", "noframes", "noscript", "textarea", "title"};
+
+
+// Tokenizer states set by the tree construction stage after start tags.
+const std::unordered_map<string_type, tokenizer_state> raw_text_states = {
+	{"title", tokenizer_state::rcdata},
+	{"textarea", tokenizer_state::rcdata},
+	{"style", tokenizer_state::rawtext},
+	{"xmp", tokenizer_state::rawtext},
+	{"iframe", tokenizer_state::rawtext},
+	{"noembed", tokenizer_state::rawtext},
+	{"noframes", tokenizer_state::rawtext},
+	{"noscript", tokenizer_state::rawtext},
+	{"script", tokenizer_state::script_data},
+	{"plaintext", tokenizer_state::plaintext}
+};
+
+
+// Code points numeric character references in range 0x80-0x9F map to.
+// They come from windows-1252 encoding.
+const unsigned int windows_1252_code_points[32] = {
+	0x20AC, 0x81, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+	0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x8D, 0x017D, 0x8F,
+	0x90, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x9D, 0x017E, 0x0178
+};
+
+
+inline char_type
+ascii_tolower(char_type ch)
+{
+	return ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;
+}
+
+
+inline bool
+is_ascii_alpha(char_type ch)
+{
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+
+inline bool
+is_ascii_digit(char_type ch)
+{
+	return ch >= '0' && ch <= '9';
+}
+
+
+inline bool
+is_ascii_hex_digit(char_type ch)
+{
+	return is_ascii_digit(ch) || (ch >= 'a' && ch <= 'f')
+		|| (ch >= 'A' && ch <= 'F');
+}
+
+
+inline bool
+is_ascii_alnum(char_type ch)
+{
+	return is_ascii_alpha(ch) || is_ascii_digit(ch);
+}
+
+
+/**
+ * @return true for tab, line feed, form feed and space.
+ */
+inline bool
+is_tokenizer_space(char_type ch)
+{
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\f';
+}
+
+
+inline void
+append_utf8(string_type& str, unsigned long code_point)
+{
+	if (code_point < 0x80) {
+		str += static_cast<char_type>(code_point);
+	}
+	else if (code_point < 0x800) {
+		str += static_cast<char_type>(0xC0 | (code_point >> 6));
+		str += static_cast<char_type>(0x80 | (code_point & 0x3F));
+	}
+	else if (code_point < 0x10000) {
+		str += static_cast<char_type>(0xE0 | (code_point >> 12));
+		str += static_cast<char_type>(0x80 | ((code_point >> 6) & 0x3F));
+		str += static_cast<char_type>(0x80 | (code_point & 0x3F));
+	}
+	else {
+		str += static_cast<char_type>(0xF0 | (code_point >> 18));
+		str += static_cast<char_type>(0x80 | ((code_point >> 12) & 0x3F));
+		str += static_cast<char_type>(0x80 | ((code_point >> 6) & 0x3F));
+		str += static_cast<char_type>(0x80 | (code_point & 0x3F));
+	}
+}
+
+
+/**
+ * Case-insensitively checks if html at the specified position starts with
+ * the specified lower case string.
+ */
+inline bool
+starts_with_ignore_case(const char_type* s, const char_type* end,
+	const char* str)
+{
+	for (; *str; ++s, ++str) {
+		if (s == end || ascii_tolower(*s) != *str) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * @return true if span case-insensitively equals the specified lower case
+ *	string.
+ */
+inline bool
+equals_ignore_case(const token_span& span, const string_type& str)
+{
+	return span.size() == str.size() && std::equal(span.begin, span.end,
+		std::begin(str), [](char_type ch, char_type expected) {
+			return ascii_tolower(ch) == expected;
+		});
+}
+
+
+/**
+ * Appends characters to the string until one of the stop characters is
+ * found. Line breaks are always stop characters since they have to be
+ * normalized.
+ *
+ * @return position of the first not appended character.
+ */
+inline const char_type*
+append_until(string_type& str, const char_type* s, const char_type* end,
+	const char* stop_chars)
+{
+	const char_type* start = s;
+	while (s != end && *s != '\r' && *s != '\0'
+		&& std::strchr(stop_chars, *s) == nullptr) {
+		++s;
+	}
+
+	str.append(start, s);
+	return s;
+}
+
 
 token_iterator::token_iterator(const std::string& html) : html_(html),
-	it_html_(this->html_.cbegin() - 1),
-	current_token_{token_type::illegal, "", false, attribute_list_type{}},
-	state_(tokenizer_state::data)
+	s_(html_.data()), end_(html_.data() + html_.size()), current_token_{},
+	tag_token_{}, state_(tokenizer_state::data), switch_to_raw_text_(true)
+{
+	this->advance();
+}
+
+
+token_iterator::token_iterator(const std::string& html,
+	tokenizer_state initial_state, const string_type& last_start_tag)
+	: html_(html), s_(html_.data()), end_(html_.data() + html_.size()),
+	current_token_{}, tag_token_{}, state_(initial_state),
+	switch_to_raw_text_(false), last_start_tag_(last_start_tag)
 {
-	this->current_token_ = this->next();
+	this->advance();
+}
+
+
+token&
+token_iterator::operator*()
+{
+	return this->current_token_;
 }
 
 
@@ -66,7 +248,7 @@ token_iterator::operator->()
 token_iterator&
 token_iterator::operator++()
 {
-	this->current_token_ = this->next();
+	this->advance();
 	return *this;
 }
 
@@ -74,218 +256,1828 @@ token_iterator::operator++()
 bool
 token_iterator::has_next() const
 {
-	return this->it_html_ == this->html_.cend();
+	return this->current_token_.type != token_type::end_of_file;
+}
+
+
+token
+token_iterator::next()
+{
+	this->advance();
+	return this->current_token_;
 }
 
 
 void
-token_iterator::create_tag_token_if_curr_char_is_letter(token_type type,
-	tokenizer_state new_state)
+token_iterator::advance()
 {
-	if (is_chartype(*this->it_html_, ct_start_symbol)) {
-		this->state_ = new_state;
+	if (this->tag_token_pending_) {
+		std::swap(this->current_token_, this->tag_token_);
+		this->tag_token_pending_ = false;
+		return;
+	}
+
+	token& current = this->current_token_;
+	current.type = token_type::illegal;
+	current.has_attributes = false;
+	current.attributes.clear();
+	current.self_closing = false;
+	current.public_identifier.clear();
+	current.system_identifier.clear();
+	current.force_quirks = false;
+
+	if (!this->eof_) {
+		this->run_state_machine();
+	}
 
-		std::string tag_name;
-		tag_name = *this->it_html_;
-		this->current_token_ = token{type, tag_name, false,
-			attribute_list_type{}};
+	if (this->current_token_.type != token_type::illegal) {
+		return;
 	}
+
+	// Characters left before the end of file.
+	if (!this->text_.empty()) {
+		this->current_token_.type = token_type::string;
+		this->current_token_.value.swap(this->text_);
+		this->text_.clear();
+		return;
+	}
+
+	this->current_token_.type = token_type::end_of_file;
+	this->current_token_.value.clear();
 }
 
 
-bool
-token_iterator::on_data_state()
+void
+token_iterator::create_tag_token(token_type type)
 {
-	bool token_emitted = false;
+	token& tag = this->tag_token_;
+	tag.type = type;
+	tag.value.clear();
+	tag.has_attributes = false;
+	tag.attributes.clear();
+	tag.self_closing = false;
+	tag.public_identifier.clear();
+	tag.system_identifier.clear();
+	tag.force_quirks = false;
+}
+
+
+void
+token_iterator::start_attribute()
+{
+	this->finish_attribute();
+
+	this->in_attribute_ = true;
+	this->attribute_name_.clear();
+	this->attribute_value_.clear();
+}
 
-	++this->it_html_;
 
-	// Check if the current character is the start tag character
-	if (*this->it_html_ == tag_open_char) {
-		this->state_ = tokenizer_state::tag_open;
+void
+token_iterator::finish_attribute()
+{
+	if (!this->in_attribute_) {
+		return;
 	}
-	else {
-		this->create_tag_token_if_curr_char_is_letter(
-			token_type::start_tag, tokenizer_state::tag_name);
+
+	this->in_attribute_ = false;
+	this->tag_token_.has_attributes = true;
+	// When attribute names are duplicated, the first one is kept.
+	this->tag_token_.attributes.emplace(this->attribute_name_,
+		this->attribute_value_);
+}
+
+
+void
+token_iterator::emit_tag_token()
+{
+	this->finish_attribute();
+
+	token& tag = this->tag_token_;
+	if (tag.type == token_type::start_tag) {
+		this->last_start_tag_ = tag.value;
+
+		if (this->switch_to_raw_text_) {
+			auto it = raw_text_states.find(tag.value);
+			if (it != std::end(raw_text_states)) {
+				this->state_ = it->second;
+			}
+		}
 	}
 
-	return token_emitted;
+	if (this->text_.empty()) {
+		std::swap(this->current_token_, tag);
+	}
+	else {
+		this->current_token_.type = token_type::string;
+		this->current_token_.value.swap(this->text_);
+		this->text_.clear();
+		this->tag_token_pending_ = true;
+	}
 }
 
 
 bool
-token_iterator::on_tag_open_state()
+token_iterator::is_appropriate_end_tag() const
 {
-	bool token_emitted = false;
+	return !this->last_start_tag_.empty()
+		&& this->tag_token_.value == this->last_start_tag_;
+}
 
-	++this->it_html_;
 
-	if (*this->it_html_ == solidus_char) {
-		this->state_ = tokenizer_state::end_tag_open;
+bool
+token_iterator::on_raw_text_end_tag_name(char_type ch,
+	tokenizer_state text_state)
+{
+	if (is_tokenizer_space(ch) && this->is_appropriate_end_tag()) {
+		this->state_ = tokenizer_state::before_attribute_name;
+	}
+	else if (ch == solidus_char && this->is_appropriate_end_tag()) {
+		this->state_ = tokenizer_state::self_closing_start_tag;
+	}
+	else if (ch == tag_close_char && this->is_appropriate_end_tag()) {
+		this->state_ = tokenizer_state::data;
+		this->emit_tag_token();
+		return true;
+	}
+	else if (is_ascii_alpha(ch)) {
+		this->tag_token_.value += ascii_tolower(ch);
+		this->temporary_buffer_ += ch;
 	}
 	else {
-		this->create_tag_token_if_curr_char_is_letter(
-			token_type::start_tag, tokenizer_state::tag_name);
+		this->text_ += "</";
+		this->text_ += this->temporary_buffer_;
+		--this->s_;
+		this->state_ = text_state;
 	}
 
-	return token_emitted;
+	return false;
 }
 
 
 bool
-token_iterator::on_end_tag_open_state()
+token_iterator::in_attribute_value() const
 {
-	++this->it_html_;
+	return this->return_state_ == tokenizer_state::attribute_value_double_quoted
+		|| this->return_state_ == tokenizer_state::attribute_value_single_quoted
+		|| this->return_state_ == tokenizer_state::unquoted_attribute_value;
+}
 
-	this->create_tag_token_if_curr_char_is_letter(
-		token_type::end_tag, tokenizer_state::tag_name);
 
-	return false;
+void
+token_iterator::flush_char_ref(const string_type& chars)
+{
+	if (this->in_attribute_value()) {
+		this->attribute_value_ += chars;
+	}
+	else {
+		this->text_ += chars;
+	}
 }
 
 
-bool
-token_iterator::on_tag_name_state()
+void
+token_iterator::on_named_char_ref()
 {
-	bool token_emitted = false;
+	// Longest alphanumeric run which might be a reference name.
+	const char_type* name_end = this->s_;
+	while (name_end != this->end_ && is_ascii_alnum(*name_end)
+		&& name_end - this->s_ < static_cast<std::ptrdiff_t>(
+		max_char_ref_name_size)) {
+		++name_end;
+	}
 
-	++this->it_html_;
+	const char* chars = nullptr;
+	if (name_end != this->end_ && *name_end == ';') {
+		chars = find_named_char_ref(this->s_, name_end + 1 - this->s_);
+		if (chars) {
+			++name_end;
+		}
+	}
 
-	while (is_chartype(*this->it_html_, ct_start_symbol)) {
-		this->current_token_.value += *this->it_html_;
-		++this->it_html_;
+	for (; !chars && name_end != this->s_; --name_end) {
+		chars = find_named_char_ref(this->s_, name_end - this->s_);
+		if (chars) {
+			break;
+		}
 	}
 
-	if (*this->it_html_ == tag_close_char) {
-		token_emitted = true;
-		this->state_ = tokenizer_state::data;
+	if (!chars) {
+		this->flush_char_ref(this->temporary_buffer_);
+		this->state_ = tokenizer_state::ambiguous_ampersand;
+		return;
 	}
-	else if (is_chartype(*this->it_html_, ct_space)) {
-		this->state_ = tokenizer_state::before_attribute_name;
+
+	// For historical reasons legacy references followed by '=' or
+	// alphanumeric are not decoded in attribute values.
+	bool historical = this->in_attribute_value() && name_end[-1] != ';'
+		&& name_end != this->end_
+		&& (*name_end == '=' || is_ascii_alnum(*name_end));
+	if (historical) {
+		this->flush_char_ref(this->temporary_buffer_);
+		this->flush_char_ref(string_type(this->s_, name_end));
+	}
+	else {
+		this->flush_char_ref(chars);
 	}
 
-	return token_emitted;
+	this->s_ = name_end;
+	this->state_ = this->return_state_;
 }
 
 
-bool
-token_iterator::is_eof() const
+void
+token_iterator::on_numeric_char_ref_end()
 {
-	return this->it_html_ == this->html_.end();
+	unsigned long code = this->char_ref_code_;
+	if (code == 0 || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) {
+		code = 0xFFFD;
+	}
+	else if (code >= 0x80 && code <= 0x9F) {
+		code = windows_1252_code_points[code - 0x80];
+	}
+
+	string_type chars;
+	append_utf8(chars, code);
+	this->flush_char_ref(chars);
+
+	this->state_ = this->return_state_;
 }
 
 
-bool
-token_iterator::on_before_attribute_name_state()
+void
+token_iterator::on_eof()
+{
+	this->eof_ = true;
+
+	switch (this->state_) {
+	case tokenizer_state::tag_open:
+	case tokenizer_state::rcdata_less_than_sign:
+	case tokenizer_state::rawtext_less_than_sign:
+	case tokenizer_state::script_data_less_than_sign:
+	case tokenizer_state::script_data_escaped_less_than_sign:
+		this->text_ += '<';
+		break;
+
+	case tokenizer_state::end_tag_open:
+	case tokenizer_state::rcdata_end_tag_open:
+	case tokenizer_state::rawtext_end_tag_open:
+	case tokenizer_state::script_data_end_tag_open:
+	case tokenizer_state::script_data_escaped_end_tag_open:
+		this->text_ += "</";
+		break;
+
+	case tokenizer_state::rcdata_end_tag_name:
+	case tokenizer_state::rawtext_end_tag_name:
+	case tokenizer_state::script_data_end_tag_name:
+	case tokenizer_state::script_data_escaped_end_tag_name:
+		this->text_ += "</";
+		this->text_ += this->temporary_buffer_;
+		break;
+
+	case tokenizer_state::bogus_comment:
+	case tokenizer_state::markup_declaration_open:
+	case tokenizer_state::comment_start:
+	case tokenizer_state::comment_start_dash:
+	case tokenizer_state::comment:
+	case tokenizer_state::comment_less_than_sign:
+	case tokenizer_state::comment_less_than_sign_bang:
+	case tokenizer_state::comment_less_than_sign_bang_dash:
+	case tokenizer_state::comment_less_than_sign_bang_dash_dash:
+	case tokenizer_state::comment_end_dash:
+	case tokenizer_state::comment_end:
+	case tokenizer_state::comment_end_bang:
+		if (this->state_ == tokenizer_state::markup_declaration_open) {
+			this->create_tag_token(token_type::comment);
+		}
+		this->emit_tag_token();
+		break;
+
+	case tokenizer_state::doctype:
+	case tokenizer_state::before_doctype_name:
+		this->create_tag_token(token_type::doctype);
+		this->tag_token_.force_quirks = true;
+		this->emit_tag_token();
+		break;
+
+	case tokenizer_state::doctype_name:
+	case tokenizer_state::after_doctype_name:
+	case tokenizer_state::after_doctype_public_keyword:
+	case tokenizer_state::before_doctype_public_identifier:
+	case tokenizer_state::doctype_public_identifier_double_quoted:
+	case tokenizer_state::doctype_public_identifier_single_quoted:
+	case tokenizer_state::after_doctype_public_identifier:
+	case tokenizer_state::between_doctype_public_and_system_identifiers:
+	case tokenizer_state::after_doctype_system_keyword:
+	case tokenizer_state::before_doctype_system_identifier:
+	case tokenizer_state::doctype_system_identifier_double_quoted:
+	case tokenizer_state::doctype_system_identifier_single_quoted:
+	case tokenizer_state::after_doctype_system_identifier:
+		this->tag_token_.force_quirks = true;
+		this->emit_tag_token();
+		break;
+
+	case tokenizer_state::bogus_doctype:
+		this->emit_tag_token();
+		break;
+
+	case tokenizer_state::cdata_section_bracket:
+		this->text_ += ']';
+		break;
+
+	case tokenizer_state::cdata_section_end:
+		this->text_ += "]]";
+		break;
+
+	case tokenizer_state::character_reference:
+		this->flush_char_ref("&");
+		break;
+
+	case tokenizer_state::numeric_character_reference:
+	case tokenizer_state::hexadecimal_character_reference_start:
+	case tokenizer_state::decimal_character_reference_start:
+		this->flush_char_ref(this->temporary_buffer_);
+		break;
+
+	case tokenizer_state::hexadecimal_character_reference:
+	case tokenizer_state::decimal_character_reference:
+	case tokenizer_state::numeric_character_reference_end:
+		this->on_numeric_char_ref_end();
+		break;
+
+	default:
+		// Tags which are not finished are dropped.
+		break;
+	}
+}
+
+
+void
+token_iterator::run_state_machine()
+{
+	typedef tokenizer_state state;
+
+	while (this->current_token_.type == token_type::illegal) {
+		// States which do not consume characters.
+		if (this->state_ == state::named_character_reference) {
+			this->on_named_char_ref();
+			continue;
+		}
+		if (this->state_ == state::numeric_character_reference_end) {
+			this->on_numeric_char_ref_end();
+			continue;
+		}
+		if (this->state_ == state::markup_declaration_open) {
+			if (starts_with_ignore_case(this->s_, this->end_, "--")) {
+				this->s_ += 2;
+				this->create_tag_token(token_type::comment);
+				this->state_ = state::comment_start;
+			}
+			else if (starts_with_ignore_case(this->s_, this->end_,
+				"doctype")) {
+				this->s_ += 7;
+				this->state_ = state::doctype;
+			}
+			else {
+				// CDATA sections are only recognized in foreign
+				// content, which is not tracked.
+				this->create_tag_token(token_type::comment);
+				this->state_ = state::bogus_comment;
+			}
+			continue;
+		}
+
+		if (this->s_ == this->end_) {
+			this->on_eof();
+			return;
+		}
+
+		// Line breaks are normalized to '\n'.
+		char_type ch = *this->s_++;
+		if (ch == '\r') {
+			ch = '\n';
+			if (this->s_ != this->end_ && *this->s_ == '\n') {
+				++this->s_;
+			}
+		}
+
+		switch (this->state_) {
+		case state::data:
+			if (ch == '&') {
+				this->return_state_ = state::data;
+				this->state_ = state::character_reference;
+			}
+			else if (ch == tag_open_char) {
+				this->state_ = state::tag_open;
+			}
+			else {
+				this->text_ += ch;
+				this->s_ = append_until(this->text_, this->s_,
+					this->end_, "<&");
+			}
+			break;
+
+		case state::rcdata:
+			if (ch == '&') {
+				this->return_state_ = state::rcdata;
+				this->state_ = state::character_reference;
+			}
+			else if (ch == tag_open_char) {
+				this->state_ = state::rcdata_less_than_sign;
+			}
+			else if (ch == '\0') {
+				this->text_ += replacement_char;
+			}
+			else {
+				this->text_ += ch;
+				this->s_ = append_until(this->text_, this->s_,
+					this->end_, "<&");
+			}
+			break;
+
+		case state::rawtext:
+		case state::script_data:
+			if (ch == tag_open_char) {
+				this->state_ = this->state_ == state::rawtext
+					? state::rawtext_less_than_sign
+					: state::script_data_less_than_sign;
+			}
+			else if (ch == '\0') {
+				this->text_ += replacement_char;
+			}
+			else {
+				this->text_ += ch;
+				this->s_ = append_until(this->text_, this->s_,
+					this->end_, "<");
+			}
+			break;
+
+		case state::plaintext:
+			if (ch == '\0') {
+				this->text_ += replacement_char;
+			}
+			else {
+				this->text_ += ch;
+				this->s_ = append_until(this->text_, this->s_,
+					this->end_, "");
+			}
+			break;
+
+		case state::tag_open:
+			if (ch == '!') {
+				this->state_ = state::markup_declaration_open;
+			}
+			else if (ch == solidus_char) {
+				this->state_ = state::end_tag_open;
+			}
+			else if (is_ascii_alpha(ch)) {
+				this->create_tag_token(token_type::start_tag);
+				--this->s_;
+				this->state_ = state::tag_name;
+			}
+			else if (ch == '?') {
+				this->create_tag_token(token_type::comment);
+				--this->s_;
+				this->state_ = state::bogus_comment;
+			}
+			else {
+				this->text_ += tag_open_char;
+				--this->s_;
+				this->state_ = state::data;
+			}
+			break;
+
+		case state::end_tag_open:
+			if (is_ascii_alpha(ch)) {
+				this->create_tag_token(token_type::end_tag);
+				--this->s_;
+				this->state_ = state::tag_name;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+			}
+			else {
+				this->create_tag_token(token_type::comment);
+				--this->s_;
+				this->state_ = state::bogus_comment;
+			}
+			break;
+
+		case state::tag_name:
+			if (is_tokenizer_space(ch)) {
+				this->state_ = state::before_attribute_name;
+			}
+			else if (ch == solidus_char) {
+				this->state_ = state::self_closing_start_tag;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else if (ch == '\0') {
+				this->tag_token_.value += replacement_char;
+			}
+			else {
+				this->tag_token_.value += ascii_tolower(ch);
+			}
+			break;
+
+		case state::rcdata_less_than_sign:
+		case state::rawtext_less_than_sign:
+			if (ch == solidus_char) {
+				this->temporary_buffer_.clear();
+				this->state_ = this->state_ == state::rcdata_less_than_sign
+					? state::rcdata_end_tag_open
+					: state::rawtext_end_tag_open;
+			}
+			else {
+				this->text_ += tag_open_char;
+				--this->s_;
+				this->state_ = this->state_ == state::rcdata_less_than_sign
+					? state::rcdata : state::rawtext;
+			}
+			break;
+
+		case state::rcdata_end_tag_open:
+		case state::rawtext_end_tag_open:
+		case state::script_data_end_tag_open:
+		case state::script_data_escaped_end_tag_open: {
+			state name_state = state::script_data_escaped_end_tag_name;
+			state text_state = state::script_data_escaped;
+			if (this->state_ == state::rcdata_end_tag_open) {
+				name_state = state::rcdata_end_tag_name;
+				text_state = state::rcdata;
+			}
+			else if (this->state_ == state::rawtext_end_tag_open) {
+				name_state = state::rawtext_end_tag_name;
+				text_state = state::rawtext;
+			}
+			else if (this->state_ == state::script_data_end_tag_open) {
+				name_state = state::script_data_end_tag_name;
+				text_state = state::script_data;
+			}
+
+			--this->s_;
+			if (is_ascii_alpha(ch)) {
+				this->create_tag_token(token_type::end_tag);
+				this->state_ = name_state;
+			}
+			else {
+				this->text_ += "</";
+				this->state_ = text_state;
+			}
+			break;
+		}
+
+		case state::rcdata_end_tag_name:
+			this->on_raw_text_end_tag_name(ch, state::rcdata);
+			break;
+
+		case state::rawtext_end_tag_name:
+			this->on_raw_text_end_tag_name(ch, state::rawtext);
+			break;
+
+		case state::script_data_end_tag_name:
+			this->on_raw_text_end_tag_name(ch, state::script_data);
+			break;
+
+		case state::script_data_escaped_end_tag_name:
+			this->on_raw_text_end_tag_name(ch,
+				state::script_data_escaped);
+			break;
+
+		case state::script_data_less_than_sign:
+			if (ch == solidus_char) {
+				this->temporary_buffer_.clear();
+				this->state_ = state::script_data_end_tag_open;
+			}
+			else if (ch == '!') {
+				this->text_ += "<!";
+				this->state_ = state::script_data_escape_start;
+			}
+			else {
+				this->text_ += tag_open_char;
+				--this->s_;
+				this->state_ = state::script_data;
+			}
+			break;
+
+		case state::script_data_escape_start:
+		case state::script_data_escape_start_dash:
+			if (ch == '-') {
+				this->text_ += '-';
+				this->state_ = this->state_
+					== state::script_data_escape_start
+					? state::script_data_escape_start_dash
+					: state::script_data_escaped_dash_dash;
+			}
+			else {
+				--this->s_;
+				this->state_ = state::script_data;
+			}
+			break;
+
+		case state::script_data_escaped:
+		case state::script_data_escaped_dash:
+		case state::script_data_escaped_dash_dash:
+			if (ch == '-') {
+				this->text_ += '-';
+				if (this->state_ == state::script_data_escaped) {
+					this->state_ = state::script_data_escaped_dash;
+				}
+				else {
+					this->state_ = state::script_data_escaped_dash_dash;
+				}
+			}
+			else if (ch == tag_open_char) {
+				this->state_ = state::script_data_escaped_less_than_sign;
+			}
+			else if (ch == tag_close_char
+				&& this->state_ == state::script_data_escaped_dash_dash) {
+				this->text_ += tag_close_char;
+				this->state_ = state::script_data;
+			}
+			else {
+				if (ch == '\0') {
+					this->text_ += replacement_char;
+				}
+				else {
+					this->text_ += ch;
+				}
+				this->state_ = state::script_data_escaped;
+			}
+			break;
+
+		case state::script_data_escaped_less_than_sign:
+			if (ch == solidus_char) {
+				this->temporary_buffer_.clear();
+				this->state_ = state::script_data_escaped_end_tag_open;
+			}
+			else if (is_ascii_alpha(ch)) {
+				this->temporary_buffer_.clear();
+				this->text_ += tag_open_char;
+				--this->s_;
+				this->state_ = state::script_data_double_escape_start;
+			}
+			else {
+				this->text_ += tag_open_char;
+				--this->s_;
+				this->state_ = state::script_data_escaped;
+			}
+			break;
+
+		case state::script_data_double_escape_start:
+		case state::script_data_double_escape_end:
+			if (is_tokenizer_space(ch) || ch == solidus_char
+				|| ch == tag_close_char) {
+				bool script = this->temporary_buffer_ == "script";
+				if (this->state_ == state::script_data_double_escape_start) {
+					this->state_ = script
+						? state::script_data_double_escaped
+						: state::script_data_escaped;
+				}
+				else {
+					this->state_ = script
+						? state::script_data_escaped
+						: state::script_data_double_escaped;
+				}
+				this->text_ += ch;
+			}
+			else if (is_ascii_alpha(ch)) {
+				this->temporary_buffer_ += ascii_tolower(ch);
+				this->text_ += ch;
+			}
+			else {
+				--this->s_;
+				this->state_ = this->state_
+					== state::script_data_double_escape_start
+					? state::script_data_escaped
+					: state::script_data_double_escaped;
+			}
+			break;
+
+		case state::script_data_double_escaped:
+		case state::script_data_double_escaped_dash:
+		case state::script_data_double_escaped_dash_dash:
+			if (ch == '-') {
+				this->text_ += '-';
+				if (this->state_ == state::script_data_double_escaped) {
+					this->state_ = state::script_data_double_escaped_dash;
+				}
+				else {
+					this->state_ =
+						state::script_data_double_escaped_dash_dash;
+				}
+			}
+			else if (ch == tag_open_char) {
+				this->text_ += tag_open_char;
+				this->state_ =
+					state::script_data_double_escaped_less_than_sign;
+			}
+			else if (ch == tag_close_char && this->state_
+				== state::script_data_double_escaped_dash_dash) {
+				this->text_ += tag_close_char;
+				this->state_ = state::script_data;
+			}
+			else {
+				if (ch == '\0') {
+					this->text_ += replacement_char;
+				}
+				else {
+					this->text_ += ch;
+				}
+				this->state_ = state::script_data_double_escaped;
+			}
+			break;
+
+		case state::script_data_double_escaped_less_than_sign:
+			if (ch == solidus_char) {
+				this->temporary_buffer_.clear();
+				this->text_ += solidus_char;
+				this->state_ = state::script_data_double_escape_end;
+			}
+			else {
+				--this->s_;
+				this->state_ = state::script_data_double_escaped;
+			}
+			break;
+
+		case state::before_attribute_name:
+			if (is_tokenizer_space(ch)) {
+				break;
+			}
+
+			if (ch == solidus_char || ch == tag_close_char) {
+				--this->s_;
+				this->state_ = state::after_attribute_name;
+			}
+			else if (ch == equals_sign_char) {
+				this->start_attribute();
+				this->attribute_name_ += ch;
+				this->state_ = state::attribute_name;
+			}
+			else {
+				this->start_attribute();
+				--this->s_;
+				this->state_ = state::attribute_name;
+			}
+			break;
+
+		case state::attribute_name:
+			if (is_tokenizer_space(ch) || ch == solidus_char
+				|| ch == tag_close_char) {
+				--this->s_;
+				this->state_ = state::after_attribute_name;
+			}
+			else if (ch == equals_sign_char) {
+				this->state_ = state::before_attribute_value;
+			}
+			else if (ch == '\0') {
+				this->attribute_name_ += replacement_char;
+			}
+			else {
+				this->attribute_name_ += ascii_tolower(ch);
+			}
+			break;
+
+		case state::after_attribute_name:
+			if (is_tokenizer_space(ch)) {
+				break;
+			}
+
+			if (ch == solidus_char) {
+				this->state_ = state::self_closing_start_tag;
+			}
+			else if (ch == equals_sign_char) {
+				this->state_ = state::before_attribute_value;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else {
+				this->start_attribute();
+				--this->s_;
+				this->state_ = state::attribute_name;
+			}
+			break;
+
+		case state::before_attribute_value:
+			if (is_tokenizer_space(ch)) {
+				break;
+			}
+
+			if (ch == '"') {
+				this->state_ = state::attribute_value_double_quoted;
+			}
+			else if (ch == '\'') {
+				this->state_ = state::attribute_value_single_quoted;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else {
+				--this->s_;
+				this->state_ = state::unquoted_attribute_value;
+			}
+			break;
+
+		case state::attribute_value_double_quoted:
+		case state::attribute_value_single_quoted: {
+			char_type quote = this->state_
+				== state::attribute_value_double_quoted ? '"' : '\'';
+			if (ch == quote) {
+				this->state_ = state::after_attribute_value_quoted;
+			}
+			else if (ch == '&') {
+				this->return_state_ = this->state_;
+				this->state_ = state::character_reference;
+			}
+			else if (ch == '\0') {
+				this->attribute_value_ += replacement_char;
+			}
+			else {
+				this->attribute_value_ += ch;
+				this->s_ = append_until(this->attribute_value_,
+					this->s_, this->end_, quote == '"'
+					? "\"&" : "'&");
+			}
+			break;
+		}
+
+		case state::unquoted_attribute_value:
+			if (is_tokenizer_space(ch)) {
+				this->state_ = state::before_attribute_name;
+			}
+			else if (ch == '&') {
+				this->return_state_ = state::unquoted_attribute_value;
+				this->state_ = state::character_reference;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else if (ch == '\0') {
+				this->attribute_value_ += replacement_char;
+			}
+			else {
+				this->attribute_value_ += ch;
+			}
+			break;
+
+		case state::after_attribute_value_quoted:
+			if (is_tokenizer_space(ch)) {
+				this->state_ = state::before_attribute_name;
+			}
+			else if (ch == solidus_char) {
+				this->state_ = state::self_closing_start_tag;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else {
+				--this->s_;
+				this->state_ = state::before_attribute_name;
+			}
+			break;
+
+		case state::self_closing_start_tag:
+			if (ch == tag_close_char) {
+				this->tag_token_.self_closing = true;
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else {
+				--this->s_;
+				this->state_ = state::before_attribute_name;
+			}
+			break;
+
+		case state::bogus_comment:
+			if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else if (ch == '\0') {
+				this->tag_token_.value += replacement_char;
+			}
+			else {
+				this->tag_token_.value += ch;
+				this->s_ = append_until(this->tag_token_.value,
+					this->s_, this->end_, ">");
+			}
+			break;
+
+		case state::comment_start:
+		case state::comment_start_dash:
+			if (ch == '-') {
+				this->state_ = this->state_ == state::comment_start
+					? state::comment_start_dash : state::comment_end;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else {
+				if (this->state_ == state::comment_start_dash) {
+					this->tag_token_.value += '-';
+				}
+				--this->s_;
+				this->state_ = state::comment;
+			}
+			break;
+
+		case state::comment:
+			if (ch == tag_open_char) {
+				this->tag_token_.value += ch;
+				this->state_ = state::comment_less_than_sign;
+			}
+			else if (ch == '-') {
+				this->state_ = state::comment_end_dash;
+			}
+			else if (ch == '\0') {
+				this->tag_token_.value += replacement_char;
+			}
+			else {
+				this->tag_token_.value += ch;
+				this->s_ = append_until(this->tag_token_.value,
+					this->s_, this->end_, "<-");
+			}
+			break;
+
+		case state::comment_less_than_sign:
+			if (ch == '!') {
+				this->tag_token_.value += ch;
+				this->state_ = state::comment_less_than_sign_bang;
+			}
+			else if (ch == tag_open_char) {
+				this->tag_token_.value += ch;
+			}
+			else {
+				--this->s_;
+				this->state_ = state::comment;
+			}
+			break;
+
+		case state::comment_less_than_sign_bang:
+			if (ch == '-') {
+				this->state_ = state::comment_less_than_sign_bang_dash;
+			}
+			else {
+				--this->s_;
+				this->state_ = state::comment;
+			}
+			break;
+
+		case state::comment_less_than_sign_bang_dash:
+			if (ch == '-') {
+				this->state_ = state::comment_less_than_sign_bang_dash_dash;
+			}
+			else {
+				--this->s_;
+				this->state_ = state::comment_end_dash;
+			}
+			break;
+
+		case state::comment_less_than_sign_bang_dash_dash:
+			--this->s_;
+			this->state_ = state::comment_end;
+			break;
+
+		case state::comment_end_dash:
+			if (ch == '-') {
+				this->state_ = state::comment_end;
+			}
+			else {
+				this->tag_token_.value += '-';
+				--this->s_;
+				this->state_ = state::comment;
+			}
+			break;
+
+		case state::comment_end:
+			if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else if (ch == '!') {
+				this->state_ = state::comment_end_bang;
+			}
+			else if (ch == '-') {
+				this->tag_token_.value += '-';
+			}
+			else {
+				this->tag_token_.value += "--";
+				--this->s_;
+				this->state_ = state::comment;
+			}
+			break;
+
+		case state::comment_end_bang:
+			if (ch == '-') {
+				this->tag_token_.value += "--!";
+				this->state_ = state::comment_end_dash;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else {
+				this->tag_token_.value += "--!";
+				--this->s_;
+				this->state_ = state::comment;
+			}
+			break;
+
+		case state::doctype:
+			if (!is_tokenizer_space(ch)) {
+				--this->s_;
+			}
+			this->state_ = state::before_doctype_name;
+			break;
+
+		case state::before_doctype_name:
+			if (is_tokenizer_space(ch)) {
+				break;
+			}
+
+			this->create_tag_token(token_type::doctype);
+			if (ch == tag_close_char) {
+				this->tag_token_.force_quirks = true;
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else {
+				--this->s_;
+				this->state_ = state::doctype_name;
+			}
+			break;
+
+		case state::doctype_name:
+			if (is_tokenizer_space(ch)) {
+				this->state_ = state::after_doctype_name;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else if (ch == '\0') {
+				this->tag_token_.value += replacement_char;
+			}
+			else {
+				this->tag_token_.value += ascii_tolower(ch);
+			}
+			break;
+
+		case state::after_doctype_name:
+			if (is_tokenizer_space(ch)) {
+				break;
+			}
+
+			--this->s_;
+			if (ch == tag_close_char) {
+				++this->s_;
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else if (starts_with_ignore_case(this->s_, this->end_,
+				"public")) {
+				this->s_ += 6;
+				this->state_ = state::after_doctype_public_keyword;
+			}
+			else if (starts_with_ignore_case(this->s_, this->end_,
+				"system")) {
+				this->s_ += 6;
+				this->state_ = state::after_doctype_system_keyword;
+			}
+			else {
+				this->tag_token_.force_quirks = true;
+				this->state_ = state::bogus_doctype;
+			}
+			break;
+
+		case state::after_doctype_public_keyword:
+		case state::before_doctype_public_identifier:
+		case state::after_doctype_system_keyword:
+		case state::before_doctype_system_identifier: {
+			bool is_public = this->state_
+				== state::after_doctype_public_keyword
+				|| this->state_ == state::before_doctype_public_identifier;
+			if (is_tokenizer_space(ch)) {
+				if (this->state_ == state::after_doctype_public_keyword) {
+					this->state_ = state::before_doctype_public_identifier;
+				}
+				else if (this->state_
+					== state::after_doctype_system_keyword) {
+					this->state_ = state::before_doctype_system_identifier;
+				}
+			}
+			else if (ch == '"' || ch == '\'') {
+				if (is_public) {
+					this->state_ = ch == '"'
+						? state::doctype_public_identifier_double_quoted
+						: state::doctype_public_identifier_single_quoted;
+				}
+				else {
+					this->state_ = ch == '"'
+						? state::doctype_system_identifier_double_quoted
+						: state::doctype_system_identifier_single_quoted;
+				}
+			}
+			else if (ch == tag_close_char) {
+				this->tag_token_.force_quirks = true;
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else {
+				this->tag_token_.force_quirks = true;
+				--this->s_;
+				this->state_ = state::bogus_doctype;
+			}
+			break;
+		}
+
+		case state::doctype_public_identifier_double_quoted:
+		case state::doctype_public_identifier_single_quoted:
+		case state::doctype_system_identifier_double_quoted:
+		case state::doctype_system_identifier_single_quoted: {
+			bool is_public = this->state_
+				== state::doctype_public_identifier_double_quoted
+				|| this->state_
+				== state::doctype_public_identifier_single_quoted;
+			char_type quote = this->state_
+				== state::doctype_public_identifier_double_quoted
+				|| this->state_
+				== state::doctype_system_identifier_double_quoted
+				? '"' : '\'';
+			string_type& identifier = is_public
+				? this->tag_token_.public_identifier
+				: this->tag_token_.system_identifier;
+
+			if (ch == quote) {
+				this->state_ = is_public
+					? state::after_doctype_public_identifier
+					: state::after_doctype_system_identifier;
+			}
+			else if (ch == tag_close_char) {
+				this->tag_token_.force_quirks = true;
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else if (ch == '\0') {
+				identifier += replacement_char;
+			}
+			else {
+				identifier += ch;
+			}
+			break;
+		}
+
+		case state::after_doctype_public_identifier:
+		case state::between_doctype_public_and_system_identifiers:
+			if (is_tokenizer_space(ch)) {
+				this->state_ =
+					state::between_doctype_public_and_system_identifiers;
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else if (ch == '"') {
+				this->state_ =
+					state::doctype_system_identifier_double_quoted;
+			}
+			else if (ch == '\'') {
+				this->state_ =
+					state::doctype_system_identifier_single_quoted;
+			}
+			else {
+				this->tag_token_.force_quirks = true;
+				--this->s_;
+				this->state_ = state::bogus_doctype;
+			}
+			break;
+
+		case state::after_doctype_system_identifier:
+			if (is_tokenizer_space(ch)) {
+				break;
+			}
+
+			if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			else {
+				--this->s_;
+				this->state_ = state::bogus_doctype;
+			}
+			break;
+
+		case state::bogus_doctype:
+			if (ch == tag_close_char) {
+				this->state_ = state::data;
+				this->emit_tag_token();
+			}
+			break;
+
+		case state::cdata_section:
+			if (ch == ']') {
+				this->state_ = state::cdata_section_bracket;
+			}
+			else {
+				this->text_ += ch;
+			}
+			break;
+
+		case state::cdata_section_bracket:
+			if (ch == ']') {
+				this->state_ = state::cdata_section_end;
+			}
+			else {
+				this->text_ += ']';
+				--this->s_;
+				this->state_ = state::cdata_section;
+			}
+			break;
+
+		case state::cdata_section_end:
+			if (ch == ']') {
+				this->text_ += ']';
+			}
+			else if (ch == tag_close_char) {
+				this->state_ = state::data;
+			}
+			else {
+				this->text_ += "]]";
+				--this->s_;
+				this->state_ = state::cdata_section;
+			}
+			break;
+
+		case state::character_reference:
+			this->temporary_buffer_ = "&";
+			--this->s_;
+			if (is_ascii_alnum(ch)) {
+				this->state_ = state::named_character_reference;
+			}
+			else if (ch == '#') {
+				++this->s_;
+				this->temporary_buffer_ += ch;
+				this->state_ = state::numeric_character_reference;
+			}
+			else {
+				this->flush_char_ref(this->temporary_buffer_);
+				this->state_ = this->return_state_;
+			}
+			break;
+
+		case state::ambiguous_ampersand:
+			if (is_ascii_alnum(ch)) {
+				this->flush_char_ref(string_type(1, ch));
+			}
+			else {
+				--this->s_;
+				this->state_ = this->return_state_;
+			}
+			break;
+
+		case state::numeric_character_reference:
+			this->char_ref_code_ = 0;
+			if (ch == 'x' || ch == 'X') {
+				this->temporary_buffer_ += ch;
+				this->state_ = state::hexadecimal_character_reference_start;
+			}
+			else {
+				--this->s_;
+				this->state_ = state::decimal_character_reference_start;
+			}
+			break;
+
+		case state::hexadecimal_character_reference_start:
+		case state::decimal_character_reference_start: {
+			bool hex = this->state_
+				== state::hexadecimal_character_reference_start;
+			--this->s_;
+			if (hex ? is_ascii_hex_digit(ch) : is_ascii_digit(ch)) {
+				this->state_ = hex
+					? state::hexadecimal_character_reference
+					: state::decimal_character_reference;
+			}
+			else {
+				this->flush_char_ref(this->temporary_buffer_);
+				this->state_ = this->return_state_;
+			}
+			break;
+		}
+
+		case state::hexadecimal_character_reference:
+		case state::decimal_character_reference: {
+			bool hex = this->state_
+				== state::hexadecimal_character_reference;
+			unsigned long digit = 0;
+			if (is_ascii_digit(ch)) {
+				digit = ch - '0';
+			}
+			else if (hex && is_ascii_hex_digit(ch)) {
+				digit = ascii_tolower(ch) - 'a' + 10;
+			}
+			else {
+				if (ch != ';') {
+					--this->s_;
+				}
+				this->state_ = state::numeric_character_reference_end;
+				break;
+			}
+
+			// Large values are clamped, they are all invalid.
+			this->char_ref_code_ = std::min(
+				this->char_ref_code_ * (hex ? 16 : 10) + digit,
+				0x110000ul);
+			break;
+		}
+
+		default:
+			// States which do not consume characters are handled
+			// above.
+			break;
+		}
+	}
+}
+
+
+inline bool
+is_structural_symbol(char_type ch)
+{
+	return ch == '<' || ch == '>' || ch == '"' || ch == '\''
+		|| ch == '=' || ch == '&';
+}
+
+
+void
+index_structural_chars(const char_type* html, std::size_t size,
+	std::vector<structural_block>& blocks)
 {
-	++this->it_html_;
+	blocks.assign((size + 63) / 64, structural_block{0, 0, 0});
+
+	std::size_t i = 0;
+	std::uint64_t prev_space = 0;
+
+#if defined(__SSE2__) && !defined(PUGIHTML_WCHAR_MODE)
+	const __m128i tag_open = _mm_set1_epi8('<');
+	const __m128i tag_close = _mm_set1_epi8('>');
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i apostrophe = _mm_set1_epi8('\'');
+	const __m128i equals_sign = _mm_set1_epi8('=');
+	const __m128i ampersand = _mm_set1_epi8('&');
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i carriage_return = _mm_set1_epi8('\r');
+
+	// Block of 64 characters is classified 16 characters at a time.
+	for (; i + 64 <= size; i += 64) {
+		structural_block& block = blocks[i / 64];
+		std::uint64_t symbol_mask = 0;
+		std::uint64_t space_mask = 0;
+		for (std::size_t j = 0; j < 64; j += 16) {
+			__m128i chunk = _mm_loadu_si128(
+				reinterpret_cast<const __m128i*>(html + i + j));
+
+			__m128i is_tag_open = _mm_cmpeq_epi8(chunk, tag_open);
+			__m128i is_tag_close = _mm_cmpeq_epi8(chunk, tag_close);
+			block.tag_open |= static_cast<std::uint64_t>(
+				_mm_movemask_epi8(is_tag_open)) << j;
+			block.tag_close |= static_cast<std::uint64_t>(
+				_mm_movemask_epi8(is_tag_close)) << j;
+
+			symbol_mask |= static_cast<std::uint64_t>(
+				_mm_movemask_epi8(_mm_or_si128(
+				_mm_or_si128(
+					_mm_or_si128(is_tag_open, is_tag_close),
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+						_mm_cmpeq_epi8(chunk, apostrophe))),
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, equals_sign),
+					_mm_cmpeq_epi8(chunk, ampersand))))) << j;
+			space_mask |= static_cast<std::uint64_t>(
+				_mm_movemask_epi8(_mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+					_mm_cmpeq_epi8(chunk, tab)),
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, newline),
+					_mm_cmpeq_epi8(chunk, carriage_return))))) << j;
+		}
 
-	if (this->is_eof()) {
-		throw std::runtime_error("Unexpected EOF.");
+		// Only the first character of white space run is indexed.
+		block.structural = symbol_mask
+			| (space_mask & ~((space_mask << 1) | prev_space));
+		prev_space = space_mask >> 63;
+	}
+#endif
+
+	for (; i < size; ++i) {
+		structural_block& block = blocks[i / 64];
+		const std::uint64_t bit = std::uint64_t(1) << (i % 64);
+		bool space = is_chartype(html[i], ct_space);
+		if (is_structural_symbol(html[i]) || (space && !prev_space)) {
+			block.structural |= bit;
+		}
+		if (html[i] == tag_open_char) {
+			block.tag_open |= bit;
+		}
+		else if (html[i] == tag_close_char) {
+			block.tag_close |= bit;
+		}
+		prev_space = space;
 	}
+}
+
 
-	while (is_chartype(*this->it_html_, ct_space)) {
-		++this->it_html_;
+/**
+ * @return index of the lowest set bit. Bits must not be 0.
+ */
+inline std::size_t
+lowest_bit_index(std::uint64_t bits)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(bits);
+#else
+	std::size_t index = 0;
+	for (; !(bits & 1); bits >>= 1) {
+		++index;
 	}
+	return index;
+#endif
+}
 
-	bool token_emitted = false;
-	if (*this->it_html_ == tag_close_char) {
-		this->state_ = tokenizer_state::data;
-		token_emitted = true;
+
+/**
+ * @return lower case name of raw text element or nullptr, if it's not one.
+ */
+const string_type*
+find_raw_text_element(const token_span& name)
+{
+	// Bit n of the entry for a letter is set, if there's raw text element
+	// name of length n starting with it. Most names are rejected by it
+	// without comparing strings.
+	static const std::vector<unsigned int> name_lengths = [] {
+		std::vector<unsigned int> lengths(256, 0);
+		for (auto& element : raw_text_elements) {
+			lengths[static_cast<unsigned char>(element[0])]
+				|= 1u << element.size();
+		}
+		return lengths;
+	}();
+
+	if (name.empty() || name.size() >= 32 || !(name_lengths[
+		static_cast<unsigned char>(ascii_tolower(*name.begin))]
+		& (1u << name.size()))) {
+		return nullptr;
 	}
-	else if (is_chartype(*this->it_html_, ct_start_symbol)) {
-		this->current_token_.has_attributes = true;
-		this->curr_attribute_name_ = *this->it_html_;
 
-		this->state_ = tokenizer_state::attribute_name;
+	for (auto& element : raw_text_elements) {
+		if (equals_ignore_case(name, element)) {
+			return &element;
+		}
 	}
 
-	return token_emitted;
+	return nullptr;
+}
+
+
+indexed_token_iterator::indexed_token_iterator(const string_type& html)
+	: html_(html),
+	current_token_{}
+{
+	index_structural_chars(html.data(), html.size(), this->blocks_);
+
+	this->next();
+}
+
+
+indexed_token&
+indexed_token_iterator::operator*()
+{
+	return this->current_token_;
+}
+
+
+indexed_token*
+indexed_token_iterator::operator->()
+{
+	return &this->current_token_;
+}
+
+
+indexed_token_iterator&
+indexed_token_iterator::operator++()
+{
+	this->next();
+	return *this;
 }
 
 
 bool
-token_iterator::on_attribute_name_state()
+indexed_token_iterator::has_next() const
 {
-	++this->it_html_;
+	return this->current_token_.type != token_type::end_of_file;
+}
 
-	if (is_chartype(*this->it_html_, ct_start_symbol)) {
-		this->curr_attribute_name_ += *this->it_html_;
+
+const std::vector<structural_block>&
+indexed_token_iterator::structural_index() const
+{
+	return this->blocks_;
+}
+
+
+std::size_t
+indexed_token_iterator::next_bit(std::size_t from,
+	std::uint64_t structural_block::* bitmap) const
+{
+	std::size_t block = from / 64;
+	if (block >= this->blocks_.size()) {
+		return this->html_.size();
 	}
-	else if (*this->it_html_ == equals_sign_char) {
-		this->state_ = tokenizer_state::before_attribute_value;
+
+	// Bits before from are masked out.
+	std::uint64_t bits = this->blocks_[block].*bitmap
+		& (~std::uint64_t(0) << (from % 64));
+	while (bits == 0) {
+		if (++block == this->blocks_.size()) {
+			return this->html_.size();
+		}
+		bits = this->blocks_[block].*bitmap;
 	}
 
-	return false;
+	return block * 64 + lowest_bit_index(bits);
 }
 
 
-bool
-token_iterator::on_before_attribute_value_state()
+std::size_t
+indexed_token_iterator::next_structural(std::size_t from) const
+{
+	return this->next_bit(from, &structural_block::structural);
+}
+
+
+std::size_t
+indexed_token_iterator::next_structural(std::size_t from, char_type ch) const
 {
-	++this->it_html_;
+	if (ch == tag_open_char) {
+		return this->next_bit(from, &structural_block::tag_open);
+	}
+	else if (ch == tag_close_char) {
+		return this->next_bit(from, &structural_block::tag_close);
+	}
 
-	if (is_chartype(*this->it_html_, ct_start_symbol)) {
-		this->curr_attribute_value_ = *this->it_html_;
-		this->state_ = tokenizer_state::unquoted_attribute_value;
+	std::size_t pos = this->next_structural(from);
+	while (pos < this->html_.size() && this->html_[pos] != ch) {
+		pos = this->next_structural(pos + 1);
 	}
 
-	return false;
+	return pos;
 }
 
 
-bool
-token_iterator::on_unquoted_attribute_value_state()
+token_span
+indexed_token_iterator::span(std::size_t start, std::size_t end) const
+{
+	return token_span{this->html_.data() + start, this->html_.data() + end};
+}
+
+
+void
+indexed_token_iterator::set_current_token(token_type type, std::size_t start,
+	std::size_t end)
+{
+	this->current_token_.type = type;
+	this->current_token_.value = this->span(start, end);
+	this->current_token_.attributes.clear();
+}
+
+
+void
+indexed_token_iterator::next()
 {
-	++this->it_html_;
+	const std::size_t size = this->html_.size();
+
+	if (this->raw_text_element_ && this->scan_raw_text()) {
+		return;
+	}
+
+	if (this->pos_ >= size) {
+		this->set_current_token(token_type::end_of_file, size, size);
+		return;
+	}
 
-	bool token_emitted = false;
+	std::size_t tag_open = this->next_structural(this->pos_, tag_open_char);
+	if (tag_open == this->pos_ && tag_open + 1 < size) {
+		char_type ch = this->html_[tag_open + 1];
+		if (is_chartype(ch, ct_start_symbol)) {
+			this->scan_tag(token_type::start_tag);
+			return;
+		}
+		else if (ch == solidus_char && tag_open + 2 < size
+			&& is_chartype(this->html_[tag_open + 2], ct_start_symbol)) {
+			this->scan_tag(token_type::end_tag);
+			return;
+		}
+		else if (ch == '!') {
+			this->scan_markup_declaration();
+			return;
+		}
 
-	if (is_chartype(*this->it_html_, ct_start_symbol)) {
-		this->curr_attribute_value_ += *this->it_html_;
 	}
-	else if (*this->it_html_ == tag_close_char) {
-		this->current_token_.attributes[this->curr_attribute_name_]
-			= this->curr_attribute_value_;
-		token_emitted = true;
+
+	// '<' which does not start a tag is text.
+	if (tag_open == this->pos_) {
+		tag_open = this->next_structural(tag_open + 1, tag_open_char);
 	}
 
-	return token_emitted;
+	this->set_current_token(token_type::string, this->pos_, tag_open);
+	this->pos_ = tag_open;
 }
 
 
-token
-token_iterator::next()
+void
+indexed_token_iterator::scan_tag(token_type type)
 {
-	std::map<tokenizer_state, std::function<bool()> > state_handlers = {
-		{tokenizer_state::data,
-			std::bind(&token_iterator::on_data_state, this)},
-		{tokenizer_state::tag_open,
-			std::bind(&token_iterator::on_tag_open_state, this)},
-		{tokenizer_state::end_tag_open,
-			std::bind(&token_iterator::on_end_tag_open_state, this)},
-		{tokenizer_state::tag_name,
-			std::bind(&token_iterator::on_tag_name_state, this)},
-		{tokenizer_state::before_attribute_name,
-			std::bind(&token_iterator::on_before_attribute_name_state, this)},
-		{tokenizer_state::attribute_name,
-			std::bind(&token_iterator::on_attribute_name_state, this)},
-		{tokenizer_state::before_attribute_value,
-			std::bind(&token_iterator::on_before_attribute_value_state, this)},
-		{tokenizer_state::unquoted_attribute_value,
-			std::bind(&token_iterator::on_unquoted_attribute_value_state, this)},
+	const std::size_t size = this->html_.size();
+
+	std::size_t name_start = this->pos_ + (type == token_type::end_tag
+		? 2 : 1);
+	std::size_t s = name_start;
+	while (s < size && is_chartype(this->html_[s], ct_symbol)) {
+		++s;
+	}
+	this->set_current_token(type, name_start, s);
+
+	token_span attr_name = this->span(s, s);
+	auto add_attribute = [&](std::size_t value_start,
+		std::size_t value_end) {
+		if (!attr_name.empty()) {
+			this->current_token_.attributes.emplace_back(attr_name,
+				this->span(value_start, value_end));
+			attr_name.end = attr_name.begin;
+		}
 	};
 
-	bool token_emitted = false;
-	while (!token_emitted) {
-		if (state_handlers.find(this->state_) == state_handlers.end()) {
-			throw std::runtime_error{"Unknown state."};
+	// Start of attribute name or other characters between structural ones.
+	std::size_t text_start = s;
+	while (true) {
+		s = this->next_structural(s);
+		if (s >= size) {
+			throw std::runtime_error("Unexpected EOF.");
 		}
 
-		token_emitted = state_handlers[this->state_]();
+		char_type ch = this->html_[s];
+		if (ch == '"' || ch == '\'' || ch == '&') {
+			// Part of attribute name.
+			++s;
+			continue;
+		}
+
+		// Slashes are not part of attribute names, e.g. <br/>.
+		std::size_t text_end = s;
+		while (text_start < text_end
+			&& this->html_[text_start] == solidus_char) {
+			++text_start;
+		}
+		if (text_start < text_end) {
+			add_attribute(text_start, text_start);
+			attr_name = this->span(text_start, text_end);
+		}
+
+		if (ch == tag_close_char) {
+			add_attribute(s, s);
+			this->pos_ = s + 1;
+			break;
+		}
+		else if (ch == equals_sign_char) {
+			++s;
+			while (s < size && is_chartype(this->html_[s], ct_space)) {
+				++s;
+			}
+
+			std::size_t value_start = s;
+			if (s < size && (this->html_[s] == '"'
+				|| this->html_[s] == '\'')) {
+				++value_start;
+				s = this->next_structural(value_start,
+					this->html_[s]);
+				add_attribute(value_start, s);
+				++s;
+			}
+			else {
+				// Unquoted value ends at white space or '>'.
+				s = this->next_structural(s);
+				while (s < size && this->html_[s] != tag_close_char
+					&& !is_chartype(this->html_[s], ct_space)) {
+					s = this->next_structural(s + 1);
+				}
+				add_attribute(value_start, s);
+			}
+		}
+		else {
+			// White space run.
+			while (s < size && is_chartype(this->html_[s], ct_space)) {
+				++s;
+			}
+		}
+
+		text_start = s;
 	}
 
-	return this->current_token_;
+	if (type == token_type::start_tag) {
+		this->raw_text_element_ = find_raw_text_element(
+			this->current_token_.value);
+	}
+}
+
+
+void
+indexed_token_iterator::scan_markup_declaration()
+{
+	static const string_type doctype = "doctype";
+
+	const std::size_t size = this->html_.size();
+	std::size_t start = this->pos_ + 2;
+
+	if (this->html_.compare(start, 2, "--") == 0) {
+		start += 2;
+
+		std::size_t end = this->next_structural(start, tag_close_char);
+		while (end < size && (end < start + 2
+			|| this->html_[end - 1] != '-'
+			|| this->html_[end - 2] != '-')) {
+			end = this->next_structural(end + 1, tag_close_char);
+		}
+
+		this->set_current_token(token_type::comment, start,
+			end < size ? end - 2 : size);
+		this->pos_ = end < size ? end + 1 : size;
+		return;
+	}
+
+	std::size_t end = this->next_structural(start, tag_close_char);
+
+	bool is_doctype = end - start >= doctype.size() && std::equal(
+		std::begin(doctype), std::end(doctype),
+		std::begin(this->html_) + start,
+		[](char_type expected, char_type ch) {
+			return ascii_tolower(ch) == expected;
+		});
+	if (is_doctype) {
+		start += doctype.size();
+		while (start < end && is_chartype(this->html_[start], ct_space)) {
+			++start;
+		}
+		this->set_current_token(token_type::doctype, start, end);
+	}
+	else {
+		// Bogus comment, e.g. <!x>.
+		this->set_current_token(token_type::comment, start, end);
+	}
+
+	this->pos_ = end < size ? end + 1 : size;
+}
+
+
+bool
+indexed_token_iterator::scan_raw_text()
+{
+	const std::size_t size = this->html_.size();
+	const string_type& name = *this->raw_text_element_;
+
+	std::size_t end = this->next_structural(this->pos_, tag_open_char);
+	while (end < size) {
+		std::size_t name_end = end + 2 + name.size();
+		bool is_end_tag = name_end <= size
+			&& this->html_[end + 1] == solidus_char
+			&& std::equal(std::begin(name), std::end(name),
+			std::begin(this->html_) + end + 2,
+			[](char_type expected, char_type ch) {
+				return ascii_tolower(ch) == expected;
+			})
+			&& (name_end == size || this->html_[name_end] == '>'
+			|| this->html_[name_end] == solidus_char
+			|| is_chartype(this->html_[name_end], ct_space));
+		if (is_end_tag) {
+			break;
+		}
+
+		end = this->next_structural(end + 1, tag_open_char);
+	}
+
+	this->raw_text_element_ = nullptr;
+	if (end == this->pos_) {
+		return false;
+	}
+
+	this->set_current_token(token_type::string, this->pos_, end);
+	this->pos_ = end;
+	return true;
 }
 
 } // cpphtml.
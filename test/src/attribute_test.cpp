@@ -39,3 +39,17 @@ TEST(attribute, set_value_assign_operator)
 	*attr = "content";
 	ASSERT_EQ("content", attr->value());
 }
+
+
+TEST(attribute, accessors_return_stored_strings)
+{
+	auto attr = html::attribute::create("ID", "content");
+	attr->source_name("id");
+
+	ASSERT_EQ(&attr->name(), &attr->name());
+	ASSERT_EQ(&attr->value(), &attr->value());
+	ASSERT_EQ("id", attr->source_name());
+
+	attr->value("other");
+	ASSERT_EQ("other", attr->value());
+}
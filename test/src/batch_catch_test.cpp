@@ -0,0 +1,109 @@
+#include <string>
+#include <vector>
+#include <mutex>
+#include <set>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+#include <cpp-html/batch.hpp>
+#include <cpp-html/attribute.hpp>
+
+
+SCENARIO("html documents can be parsed in parallel", "[parse_batch]")
+{
+	GIVEN("a list of html documents")
+	{
+		std::vector<std::string> inputs;
+		for (int i = 0; i < 100; ++i) {
+			inputs.push_back("<html><body><div id='doc" + std::to_string(i)
+				+ "'><script>var i = " + std::to_string(i)
+				+ ";</script></div></body></html>");
+		}
+
+		WHEN("documents are parsed with 4 threads")
+		{
+			auto results = cpphtml::parse_batch(inputs, 4);
+
+			THEN("results are returned in input order")
+			{
+				REQUIRE(results.size() == inputs.size());
+
+				for (std::size_t i = 0; i < results.size(); ++i) {
+					REQUIRE(results[i].status == cpphtml::status_ok);
+					REQUIRE(results[i].doc->get_element_by_id(
+						"doc" + std::to_string(i)));
+				}
+			}
+		}
+
+		WHEN("documents are parsed with configured parser")
+		{
+			cpphtml::parser prototype;
+			prototype.skip_elements({"SCRIPT"});
+
+			auto results = cpphtml::parse_batch(inputs, 3, prototype);
+
+			THEN("parser configuration applies to every document")
+			{
+				for (auto& result : results) {
+					REQUIRE(result.doc->get_elements_by_tag_name(
+						"SCRIPT").empty());
+				}
+			}
+		}
+
+		WHEN("parser prototype collects statistics")
+		{
+			cpphtml::parse_stats stats;
+			cpphtml::parser prototype;
+			prototype.collect_stats(&stats);
+
+			auto results = cpphtml::parse_batch(inputs, 4, prototype);
+
+			THEN("workers don't update prototype statistics")
+			{
+				REQUIRE(results.size() == inputs.size());
+				REQUIRE(stats.elements == 0);
+				REQUIRE(stats.bytes_scanned == 0);
+			}
+		}
+
+		WHEN("documents are delivered through callback")
+		{
+			std::mutex mutex;
+			std::multiset<std::size_t> indices;
+
+			cpphtml::parse_batch(inputs, [&](std::size_t index,
+				const cpphtml::parse_result&) {
+				std::lock_guard<std::mutex> lock(mutex);
+				indices.insert(index);
+			}, 8);
+
+			THEN("callback is called once for each document")
+			{
+				REQUIRE(indices.size() == inputs.size());
+				for (std::size_t i = 0; i < inputs.size(); ++i) {
+					REQUIRE(indices.count(i) == 1);
+				}
+			}
+		}
+	}
+
+	GIVEN("a list with malformed html document")
+	{
+		std::vector<std::string> inputs = {"<p>ok</p>", "<p>bad</div>"};
+
+		WHEN("documents are parsed")
+		{
+			auto results = cpphtml::parse_batch(inputs, 2);
+
+			THEN("failed document has parse error status")
+			{
+				REQUIRE(results[0].status == cpphtml::status_ok);
+				REQUIRE(results[1].status
+					== cpphtml::status_end_element_mismatch);
+			}
+		}
+	}
+}
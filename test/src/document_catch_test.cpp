@@ -1,6 +1,9 @@
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 
+#include <string>
+
+#include <cpp-html/attribute.hpp>
 #include <cpp-html/document.hpp>
 #include <cpp-html/node.hpp>
 
@@ -40,4 +43,50 @@ SCENARIO("document can be queried for elements by tag name.", "[document]")
 	}
 }
 
+
+SCENARIO("document reports memory used by its tree", "[document]")
+{
+	GIVEN("a document with element, attribute and text nodes")
+	{
+		auto doc = document::create();
+		auto div = node::create(node_element);
+		div->name("div");
+		div->append_attribute("id", "content");
+		doc->append_child(div);
+
+		auto text = node::create(node_pcdata);
+		text->value(std::string(1000, 'a'));
+		div->append_child(text);
+
+		WHEN("its memory usage is measured")
+		{
+			auto usage = doc->memory_usage();
+
+			THEN("nodes are counted by type")
+			{
+				REQUIRE(usage.node_count[node_document] == 1);
+				REQUIRE(usage.node_count[node_element] == 1);
+				REQUIRE(usage.node_count[node_attribute] == 1);
+				REQUIRE(usage.node_count[node_pcdata] == 1);
+				REQUIRE(usage.total_node_count() == 4);
+			}
+
+			THEN("long strings are counted, short ones are not")
+			{
+				REQUIRE(usage.string_bytes[node_pcdata] >= 1000);
+				REQUIRE(usage.string_bytes[node_element] == 0);
+				REQUIRE(usage.string_bytes[node_attribute] == 0);
+			}
+
+			THEN("total includes nodes, strings and lists")
+			{
+				REQUIRE(usage.node_bytes[node_element]
+					>= sizeof(node));
+				REQUIRE(usage.container_bytes > 0);
+				REQUIRE(usage.total_bytes() > 1000 + 3 * sizeof(node));
+			}
+		}
+	}
+}
+
 } // cpphtml.
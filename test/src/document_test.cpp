@@ -54,3 +54,57 @@ TEST(document, links)
 	ASSERT_NE(nullptr, links[1]);
 	ASSERT_EQ("AREA", links[1]->name());
 }
+
+
+TEST(document, nodes_know_their_document)
+{
+	auto doc = html::document::create();
+	ASSERT_EQ(doc, doc->owner_document());
+
+	// Subtree built outside the document joins it when it's inserted.
+	auto div = html::node::create(html::node_element);
+	div->name("DIV");
+	auto text = div->append_child(html::node_pcdata);
+	ASSERT_EQ(nullptr, text->owner_document());
+	ASSERT_EQ(div, text->root());
+
+	doc->append_child(div);
+	ASSERT_EQ(doc, div->owner_document());
+	ASSERT_EQ(doc, text->owner_document());
+	ASSERT_EQ(doc, text->root());
+
+	doc->remove_child("DIV");
+	ASSERT_EQ(nullptr, text->owner_document());
+	ASSERT_EQ(div, text->root());
+}
+
+
+TEST(document, nodes_outliving_document_are_detached)
+{
+	auto doc = html::document::create();
+	auto div = doc->append_child(html::node_element);
+	auto text = div->append_child(html::node_pcdata);
+
+	doc.reset();
+
+	ASSERT_EQ(nullptr, div->parent());
+	ASSERT_EQ(nullptr, div->owner_document());
+	ASSERT_EQ(nullptr, text->owner_document());
+	ASSERT_EQ(div, text->root());
+}
+
+
+TEST(document, moved_nodes_change_document)
+{
+	auto doc = html::document::create();
+	auto other_doc = html::document::create();
+	auto div = doc->append_child(html::node_element);
+	auto text = div->append_child(html::node_pcdata);
+
+	div->move_to(other_doc);
+	ASSERT_EQ(nullptr, doc->first_child());
+	ASSERT_EQ(other_doc, text->owner_document());
+
+	div->remove();
+	ASSERT_EQ(nullptr, text->owner_document());
+}
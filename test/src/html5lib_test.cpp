@@ -0,0 +1,857 @@
+/**
+ * Runs fixtures in html5lib-tests format
+ * (https://github.com/html5lib/html5lib-tests) found in test/fixture/html5lib,
+ * see README.rst there:
+ *	tokenizer/NAME.test - JSON tokenizer tests run against token_iterator;
+ *	tree-construction/NAME.dat - tree construction tests run against parser.
+ *
+ * Pass rate and timing is reported for every fixture file. Tokenizer failures
+ * fail the run. Tree construction results are only reported, because parser
+ * does not implement html5 tree construction (e.g. implied html, head and
+ * body elements) yet.
+ *
+ * Usage: html5lib_test [-v]
+ *	-v prints failed tests.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+
+#include <cpp-html/attribute.hpp>
+#include <cpp-html/document.hpp>
+#include <cpp-html/parser.hpp>
+#include <cpp-html/tokenizer.hpp>
+
+
+namespace
+{
+
+const std::string html5lib_dir = TEST_FIXTURE_DIR "/html5lib";
+
+
+struct json_value {
+	enum value_type {null, boolean, number, string, array, object};
+
+	value_type type = null;
+	bool bool_value = false;
+	std::string str;
+	std::vector<json_value> items;
+	std::vector<std::pair<std::string, json_value> > members;
+
+	const json_value*
+	find(const std::string& name) const
+	{
+		for (auto& member : this->members) {
+			if (member.first == name) {
+				return &member.second;
+			}
+		}
+
+		return nullptr;
+	}
+};
+
+
+/**
+ * Minimal JSON reader for html5lib fixtures.
+ */
+class json_reader {
+public:
+	json_reader(const std::string& json) : json_(json) {}
+
+	json_value
+	read()
+	{
+		json_value value = this->read_value();
+		this->skip_spaces();
+		if (this->pos_ != this->json_.size()) {
+			this->fail("Unexpected data after JSON value.");
+		}
+
+		return value;
+	}
+
+private:
+	const std::string& json_;
+	std::size_t pos_ = 0;
+
+	void
+	fail(const std::string& msg) const
+	{
+		throw std::runtime_error(msg + " Offset: "
+			+ std::to_string(this->pos_));
+	}
+
+	void
+	skip_spaces()
+	{
+		while (this->pos_ < this->json_.size()
+			&& std::strchr(" \t\r\n", this->json_[this->pos_])) {
+			++this->pos_;
+		}
+	}
+
+	void
+	expect(char ch)
+	{
+		this->skip_spaces();
+		if (this->pos_ >= this->json_.size()
+			|| this->json_[this->pos_] != ch) {
+			this->fail(std::string("Expected '") + ch + "'.");
+		}
+		++this->pos_;
+	}
+
+	bool
+	consume(const char* literal)
+	{
+		std::size_t size = std::strlen(literal);
+		if (this->json_.compare(this->pos_, size, literal) != 0) {
+			return false;
+		}
+
+		this->pos_ += size;
+		return true;
+	}
+
+	unsigned long
+	read_hex4()
+	{
+		if (this->pos_ + 4 > this->json_.size()) {
+			this->fail("Bad unicode escape.");
+		}
+
+		unsigned long code = std::stoul(this->json_.substr(this->pos_, 4),
+			nullptr, 16);
+		this->pos_ += 4;
+		return code;
+	}
+
+	static void
+	append_utf8(std::string& str, unsigned long code)
+	{
+		if (code < 0x80) {
+			str += static_cast<char>(code);
+		}
+		else if (code < 0x800) {
+			str += static_cast<char>(0xC0 | (code >> 6));
+			str += static_cast<char>(0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000) {
+			str += static_cast<char>(0xE0 | (code >> 12));
+			str += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			str += static_cast<char>(0x80 | (code & 0x3F));
+		}
+		else {
+			str += static_cast<char>(0xF0 | (code >> 18));
+			str += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+			str += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			str += static_cast<char>(0x80 | (code & 0x3F));
+		}
+	}
+
+	std::string
+	read_string()
+	{
+		this->expect('"');
+
+		std::string str;
+		while (this->pos_ < this->json_.size()
+			&& this->json_[this->pos_] != '"') {
+			char ch = this->json_[this->pos_++];
+			if (ch != '\\') {
+				str += ch;
+				continue;
+			}
+
+			if (this->pos_ >= this->json_.size()) {
+				break;
+			}
+
+			ch = this->json_[this->pos_++];
+			switch (ch) {
+			case 'n': str += '\n'; break;
+			case 'r': str += '\r'; break;
+			case 't': str += '\t'; break;
+			case 'f': str += '\f'; break;
+			case 'b': str += '\b'; break;
+			case 'u': {
+				unsigned long code = this->read_hex4();
+				if (code >= 0xD800 && code <= 0xDBFF
+					&& this->consume("\\u")) {
+					unsigned long low = this->read_hex4();
+					code = 0x10000 + ((code - 0xD800) << 10)
+						+ (low - 0xDC00);
+				}
+				append_utf8(str, code);
+				break;
+			}
+			default: str += ch; break;
+			}
+		}
+
+		this->expect('"');
+		return str;
+	}
+
+	json_value
+	read_value()
+	{
+		this->skip_spaces();
+		if (this->pos_ >= this->json_.size()) {
+			this->fail("Unexpected end of JSON.");
+		}
+
+		json_value value;
+		char ch = this->json_[this->pos_];
+		if (ch == '"') {
+			value.type = json_value::string;
+			value.str = this->read_string();
+		}
+		else if (ch == '[') {
+			value.type = json_value::array;
+			++this->pos_;
+			this->skip_spaces();
+			if (this->json_[this->pos_] == ']') {
+				++this->pos_;
+				return value;
+			}
+
+			do {
+				value.items.push_back(this->read_value());
+				this->skip_spaces();
+			} while (this->json_[this->pos_++] == ',');
+
+			if (this->json_[this->pos_ - 1] != ']') {
+				this->fail("Expected ']'.");
+			}
+		}
+		else if (ch == '{') {
+			value.type = json_value::object;
+			++this->pos_;
+			this->skip_spaces();
+			if (this->json_[this->pos_] == '}') {
+				++this->pos_;
+				return value;
+			}
+
+			do {
+				std::string name = this->read_string();
+				this->expect(':');
+				value.members.emplace_back(name, this->read_value());
+				this->skip_spaces();
+			} while (this->json_[this->pos_++] == ',');
+
+			if (this->json_[this->pos_ - 1] != '}') {
+				this->fail("Expected '}'.");
+			}
+		}
+		else if (this->consume("true")) {
+			value.type = json_value::boolean;
+			value.bool_value = true;
+		}
+		else if (this->consume("false")) {
+			value.type = json_value::boolean;
+		}
+		else if (this->consume("null")) {
+			value.type = json_value::null;
+		}
+		else {
+			value.type = json_value::number;
+			while (this->pos_ < this->json_.size()
+				&& std::strchr("+-.eE0123456789",
+				this->json_[this->pos_])) {
+				value.str += this->json_[this->pos_++];
+			}
+
+			if (value.str.empty()) {
+				this->fail("Unexpected character.");
+			}
+		}
+
+		return value;
+	}
+};
+
+
+std::string
+read_file(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+
+	std::ostringstream content;
+	content << file.rdbuf();
+	return content.str();
+}
+
+
+/**
+ * @return sorted names of files with the specified extension.
+ */
+std::vector<std::string>
+list_files(const std::string& dir_path, const std::string& extension)
+{
+	std::vector<std::string> files;
+
+	DIR* dir = opendir(dir_path.c_str());
+	if (dir == nullptr) {
+		return files;
+	}
+
+	while (dirent* entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if (name.size() > extension.size() && name.compare(
+			name.size() - extension.size(), std::string::npos,
+			extension) == 0) {
+			files.push_back(name);
+		}
+	}
+	closedir(dir);
+
+	std::sort(std::begin(files), std::end(files));
+	return files;
+}
+
+
+struct test_result {
+	std::string name;
+	bool passed;
+	double time_ms;
+	std::string expected;
+	std::string actual;
+};
+
+
+struct fixture_result {
+	std::string name;
+	std::vector<test_result> tests;
+	std::size_t skipped = 0;
+
+	std::size_t
+	passed() const
+	{
+		return std::count_if(std::begin(this->tests), std::end(this->tests),
+			[](const test_result& result) { return result.passed; });
+	}
+};
+
+
+/**
+ * Runs the test function and measures its time.
+ *
+ * @param run_test returns actual output.
+ */
+template <typename TestFunction>
+test_result
+run_test(const std::string& name, const std::string& expected,
+	TestFunction run_test)
+{
+	test_result result{name, false, 0, expected, ""};
+
+	auto start = std::chrono::steady_clock::now();
+	try {
+		result.actual = run_test();
+	}
+	catch (const std::exception& e) {
+		result.actual = std::string("exception: ") + e.what();
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	result.time_ms = std::chrono::duration<double, std::milli>(
+		end - start).count();
+	result.passed = result.actual == result.expected;
+	return result;
+}
+
+
+//
+// Tokenizer tests.
+//
+
+std::string
+quote_json(const std::string& str)
+{
+	std::ostringstream out;
+	out << '"';
+	for (unsigned char ch : str) {
+		if (ch == '"' || ch == '\\') {
+			out << '\\' << ch;
+		}
+		else if (ch < 0x20) {
+			out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+				<< static_cast<int>(ch) << std::dec;
+		}
+		else {
+			out << ch;
+		}
+	}
+	out << '"';
+
+	return out.str();
+}
+
+
+/**
+ * Formats expected token the same way as the actual one. Missing doctype
+ * names and identifiers (null) are formatted as empty strings.
+ */
+std::string
+format_expected_token(const json_value& token)
+{
+	const std::string& type = token.items.at(0).str;
+	std::string str = "[\"" + type + "\"";
+
+	if (type == "DOCTYPE") {
+		for (std::size_t i = 1; i <= 3; ++i) {
+			str += ", " + quote_json(token.items.at(i).str);
+		}
+		str += token.items.at(4).bool_value ? ", true" : ", false";
+	}
+	else if (type == "StartTag") {
+		str += ", " + quote_json(token.items.at(1).str) + ", {";
+
+		std::map<std::string, std::string> attributes;
+		for (auto& attr : token.items.at(2).members) {
+			attributes.insert(std::make_pair(attr.first, attr.second.str));
+		}
+
+		bool first = true;
+		for (auto& attr : attributes) {
+			str += (first ? "" : ", ") + quote_json(attr.first) + ": "
+				+ quote_json(attr.second);
+			first = false;
+		}
+		str += "}";
+
+		if (token.items.size() > 3 && token.items[3].bool_value) {
+			str += ", true";
+		}
+	}
+	else {
+		str += ", " + quote_json(token.items.at(1).str);
+	}
+
+	return str + "]";
+}
+
+
+std::string
+format_token(const cpphtml::token& token)
+{
+	using cpphtml::token_type;
+
+	switch (token.type) {
+	case token_type::doctype:
+		return "[\"DOCTYPE\", " + quote_json(token.value) + ", "
+			+ quote_json(token.public_identifier) + ", "
+			+ quote_json(token.system_identifier)
+			+ (token.force_quirks ? ", false]" : ", true]");
+
+	case token_type::start_tag: {
+		std::string str = "[\"StartTag\", " + quote_json(token.value)
+			+ ", {";
+
+		std::map<std::string, std::string> attributes(
+			std::begin(token.attributes), std::end(token.attributes));
+		bool first = true;
+		for (auto& attr : attributes) {
+			str += (first ? "" : ", ") + quote_json(attr.first) + ": "
+				+ quote_json(attr.second);
+			first = false;
+		}
+
+		return str + (token.self_closing ? "}, true]" : "}]");
+	}
+
+	case token_type::end_tag:
+		return "[\"EndTag\", " + quote_json(token.value) + "]";
+
+	case token_type::comment:
+		return "[\"Comment\", " + quote_json(token.value) + "]";
+
+	case token_type::string:
+		return "[\"Character\", " + quote_json(token.value) + "]";
+
+	default:
+		return "[\"Unexpected\"]";
+	}
+}
+
+
+/**
+ * @return initial tokenizer state for html5lib state name.
+ */
+cpphtml::tokenizer_state
+tokenizer_state_from_name(const std::string& name)
+{
+	using cpphtml::tokenizer_state;
+
+	static const std::map<std::string, tokenizer_state> states = {
+		{"Data state", tokenizer_state::data},
+		{"PLAINTEXT state", tokenizer_state::plaintext},
+		{"RCDATA state", tokenizer_state::rcdata},
+		{"RAWTEXT state", tokenizer_state::rawtext},
+		{"Script data state", tokenizer_state::script_data},
+		{"CDATA section state", tokenizer_state::cdata_section}
+	};
+
+	return states.at(name);
+}
+
+
+/**
+ * @return tokens in html5lib format, one per line. Adjacent character
+ *	tokens are merged.
+ */
+std::string
+tokenize(const std::string& input, cpphtml::tokenizer_state state,
+	const std::string& last_start_tag)
+{
+	std::string output;
+	std::string characters;
+
+	for (cpphtml::token_iterator it_token(input, state, last_start_tag);
+		it_token.has_next(); ++it_token) {
+		if (it_token->type == cpphtml::token_type::string) {
+			characters += it_token->value;
+			continue;
+		}
+
+		if (!characters.empty()) {
+			output += "[\"Character\", " + quote_json(characters)
+				+ "]\n";
+			characters.clear();
+		}
+		output += format_token(*it_token) + "\n";
+	}
+
+	if (!characters.empty()) {
+		output += "[\"Character\", " + quote_json(characters) + "]\n";
+	}
+
+	return output;
+}
+
+
+fixture_result
+run_tokenizer_fixture(const std::string& file_name)
+{
+	fixture_result fixture;
+	fixture.name = "tokenizer/" + file_name;
+
+	json_value root = json_reader(read_file(html5lib_dir + "/"
+		+ fixture.name)).read();
+	const json_value* tests = root.find("tests");
+	if (tests == nullptr) {
+		return fixture;
+	}
+
+	for (auto& test : tests->items) {
+		const json_value* description = test.find("description");
+		const json_value* input = test.find("input");
+		const json_value* output = test.find("output");
+		if (description == nullptr || input == nullptr
+			|| output == nullptr) {
+			++fixture.skipped;
+			continue;
+		}
+
+		std::string expected;
+		for (auto& token : output->items) {
+			expected += format_expected_token(token) + "\n";
+		}
+
+		std::vector<std::string> states{"Data state"};
+		if (const json_value* initial_states = test.find(
+			"initialStates")) {
+			states.clear();
+			for (auto& state : initial_states->items) {
+				states.push_back(state.str);
+			}
+		}
+
+		const json_value* last_start_tag = test.find("lastStartTag");
+		for (auto& state : states) {
+			fixture.tests.push_back(run_test(description->str
+				+ " (" + state + ")", expected, [&]() {
+				return tokenize(input->str,
+					tokenizer_state_from_name(state),
+					last_start_tag ? last_start_tag->str : "");
+			}));
+		}
+	}
+
+	return fixture;
+}
+
+
+//
+// Tree construction tests.
+//
+
+struct tree_test {
+	std::string data;
+	std::string document;
+	bool fragment = false;
+};
+
+
+/**
+ * Parses .dat file. Each test consists of #data, #errors, optional
+ * #document-fragment and #document sections.
+ */
+std::vector<tree_test>
+read_tree_tests(const std::string& content)
+{
+	std::vector<tree_test> tests;
+	std::istringstream in(content);
+
+	std::string section;
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line == "#data") {
+			tests.push_back(tree_test());
+			section = line;
+			continue;
+		}
+		if (!line.empty() && line[0] == '#' && !tests.empty()) {
+			section = line;
+			tests.back().fragment |= line == "#document-fragment";
+			continue;
+		}
+		if (tests.empty()) {
+			continue;
+		}
+
+		if (section == "#data") {
+			tests.back().data += line + "\n";
+		}
+		else if (section == "#document" && !line.empty()) {
+			tests.back().document += line + "\n";
+		}
+	}
+
+	// The last new line of data belongs to the format, not to html.
+	for (auto& test : tests) {
+		if (!test.data.empty()) {
+			test.data.erase(test.data.size() - 1);
+		}
+	}
+
+	return tests;
+}
+
+
+std::string
+to_lower(std::string str)
+{
+	std::transform(std::begin(str), std::end(str), std::begin(str),
+		[](char ch) { return ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch; });
+	return str;
+}
+
+
+/**
+ * Serializes node subtree in html5lib #document format.
+ */
+void
+serialize_tree(const std::shared_ptr<cpphtml::node>& node,
+	std::size_t depth, std::string& output)
+{
+	std::string indent = "| " + std::string(depth * 2, ' ');
+
+	switch (node->type()) {
+	case cpphtml::node_element: {
+		output += indent + "<" + to_lower(node->name()) + ">\n";
+
+		std::map<std::string, std::string> attributes;
+		for (auto it = node->attributes_begin();
+			it != node->attributes_end(); ++it) {
+			attributes[to_lower(it->name())] = it->value();
+		}
+		for (auto& attr : attributes) {
+			output += indent + "  " + attr.first + "=\"" + attr.second
+				+ "\"\n";
+		}
+		break;
+	}
+
+	case cpphtml::node_pcdata:
+	case cpphtml::node_cdata:
+		output += indent + "\"" + node->value() + "\"\n";
+		break;
+
+	case cpphtml::node_comment:
+		output += indent + "<!-- " + node->value() + " -->\n";
+		break;
+
+	case cpphtml::node_doctype:
+		output += indent + "<!DOCTYPE " + node->value() + ">\n";
+		break;
+
+	default:
+		break;
+	}
+
+	for (auto& child : node->child_nodes()) {
+		serialize_tree(child, depth + 1, output);
+	}
+}
+
+
+std::string
+build_tree(const std::string& html)
+{
+	cpphtml::parser parser(cpphtml::parser::parse_default
+		| cpphtml::parser::parse_comments
+		| cpphtml::parser::parse_doctype);
+	auto doc = parser.parse(html);
+
+	std::string output;
+	for (auto& child : doc->child_nodes()) {
+		serialize_tree(child, 0, output);
+	}
+
+	return output;
+}
+
+
+fixture_result
+run_tree_construction_fixture(const std::string& file_name)
+{
+	fixture_result fixture;
+	fixture.name = "tree-construction/" + file_name;
+
+	auto tests = read_tree_tests(read_file(html5lib_dir + "/"
+		+ fixture.name));
+	for (auto& test : tests) {
+		// Fragment parsing is not supported.
+		if (test.fragment) {
+			++fixture.skipped;
+			continue;
+		}
+
+		fixture.tests.push_back(run_test(test.data, test.document,
+			[&]() { return build_tree(test.data); }));
+	}
+
+	return fixture;
+}
+
+
+//
+// Reporting.
+//
+
+/**
+ * Prints fixture pass rate, total time and the slowest test.
+ */
+void
+report(const fixture_result& fixture, bool verbose)
+{
+	double total_ms = 0;
+	const test_result* slowest = nullptr;
+	for (auto& test : fixture.tests) {
+		total_ms += test.time_ms;
+		if (slowest == nullptr || test.time_ms > slowest->time_ms) {
+			slowest = &test;
+		}
+	}
+
+	std::size_t passed = fixture.passed();
+	std::size_t total = fixture.tests.size();
+	std::cout << std::fixed << std::setprecision(1) << fixture.name << ": "
+		<< passed << "/" << total << " passed ("
+		<< (total ? 100.0 * passed / total : 100.0) << "%), "
+		<< fixture.skipped << " skipped, " << std::setprecision(3)
+		<< total_ms << " ms";
+	if (slowest != nullptr) {
+		std::cout << ", slowest " << slowest->time_ms << " ms: "
+			<< quote_json(slowest->name);
+	}
+	std::cout << std::endl;
+
+	if (!verbose) {
+		return;
+	}
+
+	for (auto& test : fixture.tests) {
+		if (!test.passed) {
+			std::cout << "  FAILED " << quote_json(test.name)
+				<< "\n  expected:\n" << test.expected
+				<< "  actual:\n" << test.actual << std::endl;
+		}
+	}
+}
+
+
+/**
+ * @return passed and total test count of all fixtures.
+ */
+std::pair<std::size_t, std::size_t>
+report_all(const std::string& title, const std::vector<fixture_result>& fixtures,
+	bool verbose)
+{
+	std::size_t passed = 0;
+	std::size_t total = 0;
+	for (auto& fixture : fixtures) {
+		report(fixture, verbose);
+		passed += fixture.passed();
+		total += fixture.tests.size();
+	}
+
+	std::cout << std::fixed << std::setprecision(1) << title << ": "
+		<< passed << "/" << total << " passed ("
+		<< (total ? 100.0 * passed / total : 100.0) << "%)\n"
+		<< std::endl;
+
+	return std::make_pair(passed, total);
+}
+
+} // namespace.
+
+
+int
+main(int argc, char* argv[])
+{
+	bool verbose = argc > 1 && std::string(argv[1]) == "-v";
+
+	try {
+		std::vector<fixture_result> tokenizer_fixtures;
+		for (auto& file_name : list_files(html5lib_dir + "/tokenizer",
+			".test")) {
+			tokenizer_fixtures.push_back(run_tokenizer_fixture(file_name));
+		}
+
+		std::vector<fixture_result> tree_fixtures;
+		for (auto& file_name : list_files(html5lib_dir
+			+ "/tree-construction", ".dat")) {
+			tree_fixtures.push_back(
+				run_tree_construction_fixture(file_name));
+		}
+
+		auto tokenizer = report_all("html5lib tokenizer",
+			tokenizer_fixtures, verbose);
+		report_all("html5lib tree construction", tree_fixtures, verbose);
+
+		return tokenizer.first == tokenizer.second ? 0 : 1;
+	}
+	catch (const std::exception& e) {
+		std::cerr << "html5lib fixtures failed: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -81,6 +81,36 @@ SCENARIO("node tree can be translated to string")
 			}
 		}
 	}
+
+	GIVEN("tree with nested elements and siblings")
+	{
+		auto div = node::create(node_element);
+		div->name("div");
+
+		auto p = node::create(node_element);
+		p->name("p");
+		div->append_child(p);
+
+		auto b = node::create(node_element);
+		b->name("b");
+		p->append_child(b);
+
+		auto span = node::create(node_element);
+		span->name("span");
+		div->append_child(span);
+
+		WHEN("tree is translated to html string")
+		{
+			string_type str_tree = div->to_string();
+
+			THEN("end tags are written after all nested elements")
+			{
+				REQUIRE(str_tree == std::string("<div>\n"
+					"\t<p>\n\t\t<b>\n\t\t</b>\n\t</p>\n"
+					"\t<span>\n\t</span>\n</div>\n"));
+			}
+		}
+	}
 }
 
 
@@ -1,3 +1,6 @@
+#include <stdexcept>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include <cpp-html/node.hpp>
@@ -28,6 +31,23 @@ TEST(node, create_div_node)
 	ASSERT_EQ("div", div->name());
 }
 
+TEST(node, accessors_return_stored_strings)
+{
+	auto div = html::node::create(html::node_element);
+	div->name("DIV");
+	div->source_name("div");
+
+	const html::string_type& name = div->name();
+	ASSERT_EQ(&name, &div->name());
+	ASSERT_EQ("div", div->source_name());
+	ASSERT_EQ(&div->value(), &div->value());
+
+	div->name("SPAN");
+	ASSERT_EQ("SPAN", name);
+	ASSERT_EQ("SPAN", div->source_name());
+}
+
+
 TEST(node, append_attributes)
 {
 	auto div = html::node::create(html::node_element);
@@ -70,8 +90,8 @@ TEST(node, attribute_iteration)
 	auto it_attr = div->attributes_begin();
 	ASSERT_TRUE(std::equal(std::begin(exp_attrs), std::end(exp_attrs),
 		it_attr, [](const html::string_type& exp_name,
-			const std::shared_ptr<html::attribute>& curr_attr) {
-			return exp_name == curr_attr->name();
+			const html::attribute& curr_attr) {
+			return exp_name == curr_attr.name();
 		}));
 }
 
@@ -89,8 +109,8 @@ TEST(node, remove_first_attribute)
 	auto it_attr = div->attributes_begin();
 	ASSERT_TRUE(std::equal(std::begin(exp_attrs), std::end(exp_attrs),
 		it_attr, [](const html::string_type& exp_name,
-			const std::shared_ptr<html::attribute>& curr_attr) {
-			return exp_name == curr_attr->name();
+			const html::attribute& curr_attr) {
+			return exp_name == curr_attr.name();
 		}));
 }
 
@@ -108,8 +128,8 @@ TEST(node, remove_middle_attribute)
 	auto it_attr = div->attributes_begin();
 	ASSERT_TRUE(std::equal(std::begin(exp_attrs), std::end(exp_attrs),
 		it_attr, [](const html::string_type& exp_name,
-			const std::shared_ptr<html::attribute>& curr_attr) {
-			return exp_name == curr_attr->name();
+			const html::attribute& curr_attr) {
+			return exp_name == curr_attr.name();
 		}));
 }
 
@@ -127,8 +147,8 @@ TEST(node, remove_last_attribute)
 	auto it_attr = div->attributes_begin();
 	ASSERT_TRUE(std::equal(std::begin(exp_attrs), std::end(exp_attrs),
 		it_attr, [](const html::string_type& exp_name,
-			const std::shared_ptr<html::attribute>& curr_attr) {
-			return exp_name == curr_attr->name();
+			const html::attribute& curr_attr) {
+			return exp_name == curr_attr.name();
 		}));
 }
 
@@ -149,6 +169,128 @@ TEST(node, find_attribute)
 }
 
 
+TEST(node, find_attribute_by_reference)
+{
+	auto div = html::node::create(html::node_element);
+	div->append_attribute("id", "content");
+	div->append_attribute("class", "base");
+
+	auto attr = div->find_attribute(
+		[](const html::attribute& curr_attr) {
+			return curr_attr.name() == "class";
+		});
+	ASSERT_EQ("base", attr->value());
+	ASSERT_EQ(div, attr.owner());
+
+	ASSERT_FALSE(div->find_attribute(
+		[](const html::attribute& curr_attr) {
+			return curr_attr.name() == "width";
+		}));
+}
+
+
+TEST(node, many_attributes)
+{
+	auto div = html::node::create(html::node_element);
+	for (int i = 0; i < 10; ++i) {
+		div->append_attribute("a" + std::to_string(i), std::to_string(i));
+	}
+	div->prepend_attribute("id", "content");
+
+	ASSERT_EQ("id", div->first_attribute()->name());
+	ASSERT_EQ("9", div->last_attribute()->value());
+	ASSERT_EQ("5", div->get_attribute("a5")->value());
+	ASSERT_EQ(11, std::distance(div->attributes_begin(),
+		div->attributes_end()));
+
+	ASSERT_TRUE(div->remove_attribute("a0"));
+	ASSERT_FALSE(div->remove_attribute("a0"));
+	ASSERT_EQ("a1", std::next(div->attributes_begin())->name());
+	ASSERT_EQ(10, std::distance(div->attributes_begin(),
+		div->attributes_end()));
+}
+
+
+TEST(node, append_copy_of_own_attribute)
+{
+	auto div = html::node::create(html::node_element);
+	for (int i = 0; i < 4; ++i) {
+		div->append_attribute("a" + std::to_string(i),
+			html::string_type(100, 'a' + i));
+	}
+
+	// Attributes outgrow their storage while the copied one is in it.
+	div->append_attribute(div->first_attribute());
+	div->prepend_attribute(div->get_attribute("a3"));
+
+	ASSERT_EQ(6, std::distance(div->attributes_begin(),
+		div->attributes_end()));
+	ASSERT_EQ(html::string_type(100, 'd'), div->first_attribute()->value());
+	ASSERT_EQ(html::string_type(100, 'a'), div->last_attribute()->value());
+}
+
+
+TEST(node, attribute_handle_is_attribute_position)
+{
+	auto a = html::node::create(html::node_element);
+	a->append_attribute("HREF", "index.html");
+
+	auto href = a->get_attribute("HREF");
+	href->value("about.html");
+	ASSERT_EQ("about.html", a->get_attribute("HREF")->value());
+	ASSERT_EQ(a->get_attribute("HREF"), href);
+	ASSERT_EQ(a, href.owner());
+
+	a->remove_attribute("HREF");
+	ASSERT_FALSE(href);
+	ASSERT_EQ(nullptr, href);
+	ASSERT_EQ(nullptr, href.owner());
+	ASSERT_THROW(href->value(), std::out_of_range);
+}
+
+
+TEST(node, move_strings_into_node)
+{
+	html::string_type long_text(1000, 'a');
+	const char* long_text_data = long_text.data();
+
+	auto text_node = html::node::create();
+	text_node->value(std::move(long_text));
+	ASSERT_EQ(long_text_data, text_node->value().data());
+
+	auto div = html::node::create(html::node_element);
+	div->name(html::string_type("DIV"));
+	div->source_name(html::string_type("div"));
+	ASSERT_EQ("DIV", div->name());
+	ASSERT_EQ("div", div->source_name());
+
+	html::string_type long_value(1000, 'b');
+	const char* long_value_data = long_value.data();
+	auto attr = div->append_attribute("class", std::move(long_value));
+	ASSERT_EQ(long_value_data, attr->value().data());
+
+	html::attribute id("id", "content");
+	div->prepend_attribute(std::move(id));
+	ASSERT_EQ("content", div->first_attribute()->value());
+}
+
+
+TEST(node, append_child_of_type)
+{
+	auto div = html::node::create(html::node_element);
+	div->append_child(html::node::create(html::node_element));
+
+	auto text = div->append_child(html::node_pcdata);
+	text->value("text");
+
+	ASSERT_EQ(2u, div->child_nodes().size());
+	ASSERT_EQ(text, div->last_child());
+	ASSERT_EQ(html::node_pcdata, text->type());
+	ASSERT_EQ(div, text->parent());
+	ASSERT_EQ(div->first_child(), text->previous_sibling());
+}
+
+
 TEST(node, child_iteration)
 {
 	// <div> <h1></h1> <p></p> <input/> </div>
@@ -238,6 +380,51 @@ TEST(node, sibling)
 }
 
 
+TEST(node, previous_sibling_by_name_returns_nearest_sibling)
+{
+	// <div> <p></p> <p></p> <input/> </div>
+	auto div = html::node::create(html::node_element);
+
+	auto p1 = html::node::create(html::node_element);
+	p1->name("p");
+	div->append_child(p1);
+
+	auto p2 = html::node::create(html::node_element);
+	p2->name("p");
+	div->append_child(p2);
+
+	auto input = html::node::create(html::node_element);
+	input->name("input");
+	div->append_child(input);
+
+	ASSERT_EQ(p2, input->previous_sibling("p"));
+	ASSERT_EQ(p1, p2->previous_sibling("p"));
+	ASSERT_EQ(nullptr, p1->previous_sibling("p"));
+}
+
+
+TEST(node, sibling_by_name_skips_other_siblings_both_ways)
+{
+	// <div> <p></p> <b></b> <p></p> <b></b> <p></p> </div>
+	auto div = html::node::create(html::node_element);
+	std::vector<std::shared_ptr<html::node> > children;
+	for (auto name : {"p", "b", "p", "b", "p"}) {
+		auto child = html::node::create(html::node_element);
+		child->name(name);
+		div->append_child(child);
+		children.push_back(child);
+	}
+
+	ASSERT_EQ(children[2], children[4]->previous_sibling("p"));
+	ASSERT_EQ(children[3], children[4]->previous_sibling("b"));
+	ASSERT_EQ(children[0], children[1]->previous_sibling("p"));
+	ASSERT_EQ(children[2], children[0]->next_sibling("p"));
+	ASSERT_EQ(children[3], children[2]->next_sibling("b"));
+	ASSERT_EQ(nullptr, children[0]->previous_sibling("b"));
+	ASSERT_EQ(nullptr, children[4]->next_sibling("p"));
+}
+
+
 TEST(node, get_parent_and_root)
 {
 	auto div = html::node::create(html::node_element);
@@ -261,6 +448,48 @@ TEST(node, get_parent_and_root)
 }
 
 
+TEST(node, parent_is_cleared_when_parent_is_destroyed)
+{
+	auto div = html::node::create(html::node_element);
+	auto p = div->append_child(html::node_element);
+
+	div.reset();
+
+	ASSERT_EQ(nullptr, p->parent());
+	ASSERT_EQ(nullptr, p->next_sibling());
+}
+
+
+TEST(node, navigate_by_reference)
+{
+	// <div> <p>text</p> <b></b> </div>
+	auto div = html::node::create(html::node_element);
+	auto p = div->append_child(html::node_element);
+	auto text = p->append_child(html::node_pcdata);
+	auto b = div->append_child(html::node_element);
+
+	html::node_ref div_ref = div->ref();
+	ASSERT_EQ(p.get(), div_ref.first_child().get());
+	ASSERT_EQ(b.get(), div_ref.last_child().get());
+	ASSERT_EQ(b.get(), div_ref.first_child().next_sibling().get());
+	ASSERT_EQ(p.get(), b->ref().previous_sibling().get());
+	ASSERT_FALSE(b->ref().next_sibling());
+	ASSERT_EQ(div.get(), text->ref().parent().parent().get());
+	ASSERT_EQ(div.get(), text->ref().root().get());
+	ASSERT_EQ(text, text->ref().lock());
+
+	std::vector<const html::node*> order;
+	for (html::node_ref curr = div_ref.first_child(); curr;
+		curr = curr.next(div_ref)) {
+		order.push_back(curr.get());
+	}
+	ASSERT_EQ((std::vector<const html::node*>{p.get(), text.get(),
+		b.get()}), order);
+
+	ASSERT_FALSE(p->ref().next(p->ref()).next(p->ref()));
+}
+
+
 TEST(node, prepend_child)
 {
 	auto div = html::node::create(html::node_element);
@@ -306,6 +535,134 @@ TEST(node, remove_child)
 }
 
 
+TEST(node, remove_child_reports_whether_child_was_found)
+{
+	auto div = html::node::create(html::node_element);
+	auto p = div->append_child(html::node_element);
+	p->name("p");
+
+	ASSERT_FALSE(div->remove_child("a"));
+	ASSERT_EQ(p, div->first_child());
+
+	ASSERT_TRUE(div->remove_child("p"));
+	ASSERT_EQ(nullptr, div->first_child());
+	ASSERT_EQ(nullptr, p->parent());
+}
+
+
+/**
+ * @return names of child nodes joined, e.g. "abc".
+ */
+static html::string_type
+child_names(const std::shared_ptr<html::node>& parent)
+{
+	html::string_type names;
+	for (auto& child : parent->child_nodes()) {
+		names += child->name();
+	}
+
+	return names;
+}
+
+
+static std::shared_ptr<html::node>
+append_named_child(const std::shared_ptr<html::node>& parent,
+	const html::string_type& name)
+{
+	auto child = parent->append_child(html::node_element);
+	child->name(name);
+	return child;
+}
+
+
+TEST(node, remove_detaches_node)
+{
+	auto div = html::node::create(html::node_element);
+	auto a = append_named_child(div, "a");
+	auto b = append_named_child(div, "b");
+	auto c = append_named_child(div, "c");
+
+	ASSERT_TRUE(b->remove());
+	ASSERT_EQ("ac", child_names(div));
+	ASSERT_EQ(nullptr, b->parent());
+	ASSERT_EQ(c, a->next_sibling());
+	ASSERT_FALSE(b->remove());
+
+	// Node owned only by its parent is destroyed after removal.
+	std::weak_ptr<html::node> weak_c = c;
+	c.reset();
+	ASSERT_TRUE(weak_c.lock()->remove());
+	ASSERT_TRUE(weak_c.expired());
+	ASSERT_EQ("a", child_names(div));
+}
+
+
+TEST(node, insert_before_and_after)
+{
+	auto div = html::node::create(html::node_element);
+	auto b = append_named_child(div, "b");
+
+	auto a = html::node::create(html::node_element);
+	a->name("a");
+	div->insert_before(a, b);
+
+	auto c = html::node::create(html::node_element);
+	c->name("c");
+	div->insert_after(c, b);
+
+	ASSERT_EQ("abc", child_names(div));
+	ASSERT_EQ(div, a->parent());
+	ASSERT_EQ(b, c->previous_sibling());
+
+	// Inserting a child of the same parent reorders it.
+	div->insert_after(a, c);
+	ASSERT_EQ("bca", child_names(div));
+	ASSERT_EQ(a, div->last_child());
+
+	auto other = html::node::create(html::node_element);
+	ASSERT_THROW(div->insert_before(other, other),
+		std::invalid_argument);
+}
+
+
+TEST(node, move_to_another_parent)
+{
+	auto doc_div = html::node::create(html::node_element);
+	auto ul = append_named_child(doc_div, "ul");
+	auto li = append_named_child(ul, "li");
+	auto text = li->append_child(html::node_pcdata);
+
+	auto target = html::node::create(html::node_element);
+	append_named_child(target, "p");
+
+	ul->move_to(target);
+
+	ASSERT_EQ("", child_names(doc_div));
+	ASSERT_EQ("pul", child_names(target));
+	ASSERT_EQ(target, ul->parent());
+	ASSERT_EQ(ul, li->parent());
+	ASSERT_EQ(target, text->root());
+	ASSERT_EQ(nullptr, ul->next_sibling());
+	ASSERT_EQ(ul, target->last_child());
+}
+
+
+TEST(node, move_into_own_subtree_throws)
+{
+	auto div = html::node::create(html::node_element);
+	auto ul = append_named_child(div, "ul");
+	auto li = append_named_child(ul, "li");
+
+	ASSERT_THROW(ul->move_to(ul), std::invalid_argument);
+	ASSERT_THROW(ul->move_to(li), std::invalid_argument);
+	ASSERT_THROW(li->prepend_child(div), std::invalid_argument);
+
+	ASSERT_EQ(div, ul->parent());
+	ASSERT_EQ(ul, li->parent());
+	ASSERT_EQ("li", child_names(ul));
+}
+
+
 TEST(node, find_child)
 {
 	auto div = html::node::create(html::node_element);
@@ -344,6 +701,17 @@ TEST(node, find_node)
 }
 
 
+TEST(node, find_node_in_node_without_children)
+{
+	auto div = html::node::create(html::node_element);
+
+	auto child = div->find_node([](const std::shared_ptr<html::node>&) {
+		return true;
+	});
+	ASSERT_EQ(nullptr, child);
+}
+
+
 TEST(node, find_child_by_attribute)
 {
 	auto div = html::node::create(html::node_element);
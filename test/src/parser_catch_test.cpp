@@ -1,9 +1,13 @@
+#include <fstream>
 #include <string>
+#include <sstream>
+#include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 
 #include <cpp-html/parser.hpp>
+#include <cpp-html/attribute.hpp>
 
 
 SCENARIO("cpphtml parser creates DOM document from html string", "[parser]")
@@ -263,3 +267,908 @@ SCENARIO("cpphtml parser creates DOM document from html string", "[parser]")
 		}
 	}
 }
+
+
+SCENARIO("parser drops whitespace only pcdata by default", "[parser]")
+{
+	GIVEN("html with indented elements")
+	{
+		std::string str_html{"<ul>\n\t<li>item1</li>\n\t"
+			"<li>  item2  </li>\n"
+			"                                \n</ul>"};
+
+		WHEN("it is parsed with default parse options")
+		{
+			cpphtml::parser parser;
+			auto doc = parser.parse(str_html);
+
+			THEN("whitespace text nodes are not created")
+			{
+				auto ul = doc->first_child();
+				REQUIRE(ul->child_nodes().size() == 2);
+				REQUIRE(ul->first_child()->name() == "LI");
+				REQUIRE(ul->last_child()->name() == "LI");
+			}
+
+			THEN("text with surrounding whitespace is kept as is")
+			{
+				auto li2 = doc->first_child()->last_child();
+				REQUIRE(li2->child_value() == "  item2  ");
+			}
+		}
+
+		WHEN("it is parsed with parse_ws_pcdata option")
+		{
+			cpphtml::parser parser(cpphtml::parser::parse_default
+				| cpphtml::parser::parse_ws_pcdata);
+			auto doc = parser.parse(str_html);
+
+			THEN("whitespace text nodes are added to DOM tree")
+			{
+				auto ul = doc->first_child();
+				REQUIRE(ul->child_nodes().size() == 5);
+				REQUIRE(ul->last_child()->value()
+					== "\n                                \n");
+			}
+		}
+	}
+
+	GIVEN("long text which starts with whitespace")
+	{
+		std::string text{"                    some text after spaces"};
+
+		WHEN("it is parsed")
+		{
+			cpphtml::parser parser;
+			auto doc = parser.parse("<p>" + text + "</p>");
+
+			THEN("text node is created")
+			{
+				REQUIRE(doc->first_child()->child_value() == text);
+			}
+		}
+	}
+}
+
+
+SCENARIO("raw text and RCDATA elements content is not parsed as markup",
+	"[parser]")
+{
+	GIVEN("html parser with default parse options")
+	{
+		cpphtml::parser parser;
+
+		WHEN("style element contains closing tag of other element")
+		{
+			auto doc = parser.parse("<div><style>p:after { content: "
+				"'</div>'; }</style></div>");
+
+			THEN("style content is a single text node")
+			{
+				auto style = doc->first_child()->first_child();
+				REQUIRE(style->name() == "STYLE");
+				REQUIRE(style->child_value()
+					== "p:after { content: '</div>'; }");
+			}
+		}
+
+		WHEN("script end tag has different case")
+		{
+			auto doc = parser.parse("<script>if (a<b) f();</SCRIPT >"
+				"<div></div>");
+
+			THEN("script is closed by it")
+			{
+				auto script = doc->first_child();
+				REQUIRE(script->child_value() == "if (a<b) f();");
+				REQUIRE(script->next_sibling()->name() == "DIV");
+			}
+		}
+
+		WHEN("script contains end tag of element with longer name")
+		{
+			auto doc = parser.parse("<script>x = '</scripts>';"
+				"</script>");
+
+			THEN("only exactly matching end tag closes script")
+			{
+				REQUIRE(doc->first_child()->child_value()
+					== "x = '</scripts>';");
+			}
+		}
+
+		WHEN("textarea and title contain markup")
+		{
+			auto doc = parser.parse("<title>a <b>bold</b> title</title>"
+				"<textarea><p>text</textarea>");
+
+			THEN("markup is kept as element text")
+			{
+				auto title = doc->first_child();
+				REQUIRE(title->child_value()
+					== "a <b>bold</b> title");
+				REQUIRE(title->next_sibling()->child_value()
+					== "<p>text");
+			}
+		}
+
+		WHEN("raw text element is empty")
+		{
+			auto doc = parser.parse("<script></script>");
+
+			THEN("it has no child nodes")
+			{
+				REQUIRE(doc->first_child()->child_nodes().empty());
+			}
+		}
+
+		WHEN("raw text element is not closed")
+		{
+			auto doc = parser.parse("<xmp><p>unclosed");
+
+			THEN("the rest of document is its content")
+			{
+				REQUIRE(doc->first_child()->child_value()
+					== "<p>unclosed");
+			}
+		}
+	}
+}
+
+
+SCENARIO("parser can skip or keep only the specified elements", "[parser]")
+{
+	std::string str_html{"<html><head><title>Title</title>"
+		"<link rel=\"canonical\" href=\"/page\"></head>"
+		"<body><div id=\"main\"><svg><g><svg></svg></g>"
+		"<text x='<div>'>text</text></svg>"
+		"<script>document.write('</div>');</script>"
+		"<p>paragraph</p></div>"
+		"<ul><li>item1<li>item2</ul><p>after list</p></body></html>"};
+
+	GIVEN("parser which skips svg and script elements")
+	{
+		cpphtml::parser parser;
+		parser.skip_elements({"svg", "SCRIPT"});
+
+		WHEN("html is parsed")
+		{
+			auto doc = parser.parse(str_html);
+
+			THEN("skipped elements are not added to the DOM tree")
+			{
+				REQUIRE(doc->get_elements_by_tag_name("SVG").empty());
+				REQUIRE(doc->get_elements_by_tag_name("SCRIPT")
+					.empty());
+			}
+
+			THEN("elements after skipped ones are built")
+			{
+				auto div = doc->get_element_by_id("main");
+				REQUIRE(div->child_nodes().size() == 1);
+				REQUIRE(div->first_child()->child_value()
+					== "paragraph");
+			}
+		}
+	}
+
+	GIVEN("parser which skips elements with optional end tags")
+	{
+		cpphtml::parser parser;
+		parser.skip_elements({"LI"});
+
+		WHEN("html is parsed")
+		{
+			auto doc = parser.parse(str_html);
+
+			THEN("implied end tags close skipped elements")
+			{
+				auto ul = doc->get_elements_by_tag_name("UL");
+				REQUIRE(ul.size() == 1);
+				REQUIRE(ul[0]->child_nodes().empty());
+				REQUIRE(ul[0]->next_sibling()->child_value()
+					== "after list");
+			}
+		}
+	}
+
+	GIVEN("parser which keeps only head element")
+	{
+		cpphtml::parser parser;
+		parser.keep_elements({"HEAD"});
+
+		WHEN("html is parsed")
+		{
+			auto doc = parser.parse(str_html);
+
+			THEN("head is the only document child")
+			{
+				REQUIRE(doc->child_nodes().size() == 1);
+
+				auto head = doc->first_child();
+				REQUIRE(head->name() == "HEAD");
+				REQUIRE(head->child_value("TITLE") == "Title");
+				REQUIRE(head->last_child()->get_attribute("HREF")
+					->value() == "/page");
+			}
+		}
+	}
+
+	GIVEN("parser which keeps only li elements")
+	{
+		cpphtml::parser parser;
+		parser.keep_elements({"LI"});
+
+		WHEN("html is parsed")
+		{
+			auto doc = parser.parse(str_html);
+
+			THEN("list items are document children")
+			{
+				REQUIRE(doc->child_nodes().size() == 2);
+				REQUIRE(doc->first_child()->child_value() == "item1");
+				REQUIRE(doc->last_child()->child_value() == "item2");
+			}
+		}
+	}
+}
+
+
+SCENARIO("parser stops when stop condition is satisfied", "[parser]")
+{
+	std::string str_html{"<html><head><title>Title</title>"
+		"<link rel=\"canonical\" href=\"/page\"><link rel=\"icon\">"
+		"</head><body><p>paragraph</p></body></html>"};
+
+	GIVEN("parser which stops after head end tag")
+	{
+		cpphtml::parser parser;
+		parser.stop_after_end_tag("head");
+
+		WHEN("html is parsed")
+		{
+			auto doc = parser.parse(str_html);
+
+			THEN("document contains only head element")
+			{
+				auto html = doc->first_child();
+				REQUIRE(html->child_nodes().size() == 1);
+				REQUIRE(html->first_child()->name() == "HEAD");
+			}
+
+			THEN("parser status is status_stopped")
+			{
+				REQUIRE(parser.status() == cpphtml::status_stopped);
+			}
+		}
+	}
+
+	GIVEN("parser which stops on canonical link start tag")
+	{
+		cpphtml::parser parser;
+		parser.stop_when([](cpphtml::parse_event event,
+			const std::shared_ptr<cpphtml::node>& node) {
+			auto rel = node->get_attribute("REL");
+			return event == cpphtml::event_start_tag
+				&& node->name() == "LINK" && rel
+				&& rel->value() == "canonical";
+		});
+
+		WHEN("html is parsed")
+		{
+			auto doc = parser.parse(str_html);
+
+			THEN("canonical link is the last parsed element")
+			{
+				auto head = doc->first_child()->first_child();
+				REQUIRE(head->child_nodes().size() == 2);
+				REQUIRE(head->last_child()->get_attribute("HREF")
+					->value() == "/page");
+			}
+		}
+	}
+
+	GIVEN("parser with stop condition which is never satisfied")
+	{
+		cpphtml::parser parser;
+		parser.stop_after_end_tag("table");
+
+		WHEN("html is parsed")
+		{
+			auto doc = parser.parse(str_html);
+
+			THEN("whole document is parsed")
+			{
+				REQUIRE(doc->get_elements_by_tag_name("P").size()
+					== 1);
+				REQUIRE(parser.status() == cpphtml::status_ok);
+			}
+		}
+	}
+}
+
+
+SCENARIO("parser stops when resource limit is exceeded", "[parser]")
+{
+	GIVEN("parser with resource limits")
+	{
+		cpphtml::parse_limits limits;
+		limits.max_input_size = 1024;
+		limits.max_depth = 4;
+		limits.max_nodes = 16;
+		limits.max_attributes = 2;
+		limits.max_text_length = 32;
+
+		cpphtml::parser parser;
+		parser.limits(limits);
+
+		WHEN("html is within limits")
+		{
+			auto doc = parser.parse("<div><p class='a' id='b'>text"
+				"</p></div>");
+
+			THEN("it is parsed")
+			{
+				REQUIRE(doc->get_element_by_id("b")->child_value()
+					== "text");
+				REQUIRE(parser.status() == cpphtml::status_ok);
+			}
+		}
+
+		WHEN("html is larger than maximum input size")
+		{
+			std::string str_html = "<p>" + std::string(1024, 'a')
+				+ "</p>";
+
+			THEN("parse_error is thrown")
+			{
+				REQUIRE_THROWS(parser.parse(str_html));
+				REQUIRE(parser.status()
+					== cpphtml::status_input_too_large);
+			}
+		}
+
+		WHEN("elements are nested deeper than maximum depth")
+		{
+			std::string str_html = "<div><div><div><div><div>"
+				"</div></div></div></div></div>";
+
+			THEN("parse_error with depth status is thrown")
+			{
+				try {
+					parser.parse(str_html);
+					FAIL("parse_error was not thrown");
+				}
+				catch (const cpphtml::parse_error& e) {
+					REQUIRE(e.status() == cpphtml::
+						status_depth_limit_exceeded);
+				}
+			}
+		}
+
+		WHEN("document has more nodes than allowed")
+		{
+			std::string str_html;
+			for (int i = 0; i < 10; ++i) {
+				str_html += "<p>text</p>";
+			}
+
+			THEN("parse_error is thrown")
+			{
+				REQUIRE_THROWS(parser.parse(str_html));
+				REQUIRE(parser.status()
+					== cpphtml::status_node_limit_exceeded);
+			}
+		}
+
+		WHEN("element has more attributes than allowed")
+		{
+			THEN("parse_error is thrown")
+			{
+				REQUIRE_THROWS(parser.parse("<p a=1 b=2 c=3></p>"));
+				REQUIRE(parser.status() == cpphtml::
+					status_attribute_limit_exceeded);
+			}
+		}
+
+		WHEN("text is longer than allowed")
+		{
+			std::string str_html = "<script>" + std::string(33, 'a')
+				+ "</script>";
+
+			THEN("parse_error is thrown")
+			{
+				REQUIRE_THROWS(parser.parse(str_html));
+				REQUIRE(parser.status()
+					== cpphtml::status_text_limit_exceeded);
+			}
+		}
+	}
+}
+
+
+SCENARIO("deeply nested document is parsed and released without limits",
+	"[parser]")
+{
+	GIVEN("html with 100000 nested elements")
+	{
+		std::string str_html;
+		for (int i = 0; i < 100000; ++i) {
+			str_html += "<div>";
+		}
+
+		WHEN("it is parsed with default limits")
+		{
+			cpphtml::parser parser;
+			auto doc = parser.parse(str_html);
+
+			THEN("document is released without overflowing the stack")
+			{
+				REQUIRE(parser.status() == cpphtml::status_ok);
+				doc.reset();
+				REQUIRE(doc == nullptr);
+			}
+		}
+	}
+}
+
+
+SCENARIO("parser keeps original spelling of element and attribute names",
+	"[parser]")
+{
+	GIVEN("html with lower and mixed case names")
+	{
+		cpphtml::parser parser;
+		auto doc = parser.parse("<div dataId='1'><svg viewBox='0'>"
+			"</svg><P></P></div>");
+
+		WHEN("element names are queried")
+		{
+			auto div = doc->first_child();
+			auto svg = div->first_child();
+
+			THEN("names are upper case")
+			{
+				REQUIRE(div->name() == "DIV");
+				REQUIRE(div->first_attribute()->name() == "DATAID");
+				REQUIRE(svg->get_attribute("VIEWBOX"));
+			}
+
+			THEN("source names are spelled as in html")
+			{
+				REQUIRE(div->source_name() == "div");
+				REQUIRE(div->first_attribute()->source_name()
+					== "dataId");
+				REQUIRE(svg->first_attribute()->source_name()
+					== "viewBox");
+				REQUIRE(div->last_child()->source_name() == "P");
+			}
+		}
+
+		WHEN("document is converted to string")
+		{
+			auto str_html = doc->first_child()->to_string();
+
+			THEN("original spelling is used")
+			{
+				REQUIRE(str_html == "<div>\n\t<svg>\n\t</svg>\n"
+					"\t<P>\n\t</P>\n</div>\n");
+			}
+		}
+	}
+
+	GIVEN("html with non ASCII element name")
+	{
+		cpphtml::parser parser;
+		auto doc = parser.parse("<x-\xc3\xa4" "b></x-\xc3\xa4" "B>");
+
+		THEN("only ASCII letters are converted to upper case")
+		{
+			REQUIRE(doc->first_child()->name() == "X-\xc3\xa4" "B");
+		}
+	}
+}
+
+
+SCENARIO("parser can be reused for multiple documents", "[parser]")
+{
+	GIVEN("parser with elements filter which parsed a document")
+	{
+		cpphtml::parser parser;
+		parser.skip_elements({"SCRIPT"});
+
+		auto doc1 = parser.parse("<div id='first'><script>s1</script>"
+			"</div>");
+
+		WHEN("parser is reset and another document is parsed")
+		{
+			parser.reset();
+			auto doc2 = parser.parse("<p id='second'><script>s2"
+				"</script></p>");
+
+			THEN("new document is created")
+			{
+				REQUIRE(doc1 != doc2);
+				REQUIRE(parser.get_document() == doc2);
+				REQUIRE(doc2->child_nodes().size() == 1);
+				REQUIRE(doc2->get_element_by_id("second"));
+				REQUIRE(!doc2->get_element_by_id("first"));
+			}
+
+			THEN("previous document is not changed")
+			{
+				REQUIRE(doc1->child_nodes().size() == 1);
+				REQUIRE(doc1->get_element_by_id("first"));
+			}
+
+			THEN("elements filter is still applied")
+			{
+				REQUIRE(doc2->get_elements_by_tag_name("SCRIPT")
+					.empty());
+			}
+		}
+
+		WHEN("another document is parsed without reset")
+		{
+			auto doc2 = parser.parse("<p id='second'></p>");
+
+			THEN("nodes are appended to the same document")
+			{
+				REQUIRE(doc1 == doc2);
+				REQUIRE(doc2->child_nodes().size() == 2);
+			}
+		}
+	}
+}
+
+
+/**
+ * Dumps node subtree with values and attributes, so that trees built by
+ * different parser methods could be compared.
+ */
+static std::string
+dump_tree(const std::shared_ptr<cpphtml::node>& node)
+{
+	std::ostringstream out;
+	out << node->type() << ' ' << node->name() << ' ' << node->value();
+	for (auto it = node->attributes_begin(); it != node->attributes_end();
+		++it) {
+		out << ' ' << it->name() << '=' << it->value();
+	}
+
+	out << " {";
+	for (auto& child : node->child_nodes()) {
+		out << dump_tree(child);
+	}
+	out << "}";
+
+	return out.str();
+}
+
+
+SCENARIO("large documents can be parsed on multiple threads", "[parser]")
+{
+	GIVEN("large html with elements spanning many chunks")
+	{
+		std::string html = "<!DOCTYPE html><html><head><title>a < b"
+			"</title></head><body><div id='main'>";
+		for (int i = 0; i < 3000; ++i) {
+			std::string n = std::to_string(i);
+			html += "<ul class=\"list " + n + "\"><li>item " + n
+				+ "<li>next <b>bold</b><br></ul>"
+				"<table><tr><td a='x > y'>" + n + "<td>cell"
+				"</table><p>paragraph <!-- <div> -->" + n
+				+ "<script>if (a < b) document.write('<p>');"
+				"</script><p>another<img src='" + n + "'>";
+		}
+		html += "</div></body></html>";
+
+		cpphtml::parser sequential_parser;
+		auto expected = dump_tree(sequential_parser.parse(html));
+
+		WHEN("document is parsed in parallel")
+		{
+			cpphtml::parser parser;
+			auto doc = parser.parse_parallel(html, 4);
+
+			THEN("DOM tree is the same as parsed sequentially")
+			{
+				REQUIRE(parser.status() == cpphtml::status_ok);
+				REQUIRE(dump_tree(doc) == expected);
+			}
+		}
+
+		WHEN("document has end tag without start tag")
+		{
+			cpphtml::parser parser;
+			REQUIRE_THROWS_AS(parser.parse_parallel(html + "</span>",
+				4), cpphtml::parse_error);
+
+			THEN("parser status is set from the error")
+			{
+				REQUIRE(parser.status()
+					== cpphtml::status_end_element_mismatch);
+			}
+		}
+
+		WHEN("chunk parser fails")
+		{
+			cpphtml::parser parser;
+			REQUIRE_THROWS_AS(parser.parse_parallel(html + "<a =>",
+				4), cpphtml::parse_error);
+
+			THEN("parser status is set from the chunk error")
+			{
+				REQUIRE(parser.status()
+					== cpphtml::status_bad_start_element);
+			}
+		}
+	}
+
+	GIVEN("html with CDATA sections containing markup")
+	{
+		std::string html = "<div>";
+		for (int i = 0; i < 10000; ++i) {
+			html += "<p>" + std::to_string(i) + "<![CDATA[a > b"
+				"<span>not a tag</span> > <i>]]></p>";
+		}
+		html += "</div>";
+
+		WHEN("document is parsed in parallel")
+		{
+			cpphtml::parser parser;
+			auto doc = parser.parse_parallel(html, 4);
+
+			THEN("DOM tree is the same as parsed sequentially")
+			{
+				cpphtml::parser sequential_parser;
+				REQUIRE(parser.status() == cpphtml::status_ok);
+				REQUIRE(dump_tree(doc) == dump_tree(
+					sequential_parser.parse(html)));
+			}
+		}
+	}
+
+	GIVEN("small html")
+	{
+		std::string html = "<div><p>text</div>";
+
+		WHEN("document is parsed in parallel")
+		{
+			cpphtml::parser parser;
+			auto doc = parser.parse_parallel(html, 4);
+
+			THEN("it's parsed sequentially")
+			{
+				cpphtml::parser sequential_parser;
+				REQUIRE(dump_tree(doc) == dump_tree(
+					sequential_parser.parse(html)));
+			}
+		}
+	}
+}
+
+
+SCENARIO("html scanner and tree builder can run on separate threads",
+	"[parser]")
+{
+	GIVEN("long html document")
+	{
+		std::string html = "<html><body>";
+		for (int i = 0; i < 5000; ++i) {
+			std::string n = std::to_string(i);
+			html += "<div id=d" + n + " Class='a &amp; b'><ul><li><b>"
+				"</b><li><br></ul><p><SPAN>" + n + "</span><hr/></div>";
+		}
+		html += "</body></html>";
+
+		WHEN("it's parsed with pipelined parser")
+		{
+			cpphtml::parser parser;
+			auto doc = parser.parse_pipelined(html);
+
+			THEN("DOM tree is the same as parsed sequentially")
+			{
+				cpphtml::parser sequential_parser;
+				REQUIRE(dump_tree(doc) == dump_tree(
+					sequential_parser.parse(html)));
+				REQUIRE(doc->get_element_by_id("d4999"));
+			}
+		}
+
+		WHEN("it has end tag without start tag")
+		{
+			cpphtml::parser parser;
+
+			THEN("parse error is thrown")
+			{
+				REQUIRE_THROWS_AS(parser.parse_pipelined(
+					"</span>" + html), cpphtml::parse_error);
+				REQUIRE(parser.status()
+					== cpphtml::status_end_element_mismatch);
+			}
+		}
+
+		WHEN("it has malformed tag")
+		{
+			cpphtml::parser parser;
+
+			THEN("parse error is thrown")
+			{
+				REQUIRE_THROWS_AS(parser.parse_pipelined(
+					html + "<a =>"), cpphtml::parse_error);
+				REQUIRE(parser.status()
+					== cpphtml::status_bad_start_element);
+			}
+		}
+	}
+
+	GIVEN("test fixtures and markup handled specially by parse()")
+	{
+		std::vector<std::string> documents{
+			"<div/><p>x</p>",
+			"<DiV ID=Main>text</dIv>",
+			"<p title='&amp;'>a &amp; b &lt;</p>",
+			"<a z=1 b=2 m=3 a=4>link</a>",
+			"<!DOCTYPE html><!-- comment --><br><![CDATA[x]]>"
+				"<script>if (a < b) {}</script><img src=x />",
+			"<ul><li>one<li>two</ul><table><tr><td>a<td>b</table>"
+		};
+
+		std::ifstream fixture(TEST_FIXTURE_DIR
+			"/craigslist_newyork_index.html");
+		std::stringstream fixture_html;
+		fixture_html << fixture.rdbuf();
+		documents.push_back(fixture_html.str());
+
+		WHEN("they are parsed with parse() and parse_pipelined()")
+		{
+			THEN("documents are serialized the same")
+			{
+				REQUIRE(documents.back().size() > 1000);
+
+				for (unsigned int options : {
+					cpphtml::parser::parse_default,
+					cpphtml::parser::parse_full
+					| cpphtml::parser::parse_ws_pcdata,
+					cpphtml::parser::parse_default
+					| cpphtml::parser::parse_lazy_attributes}) {
+
+					for (auto& html : documents) {
+						cpphtml::parser sequential_parser(options);
+						cpphtml::parser pipelined_parser(options);
+						REQUIRE(sequential_parser.parse(html)
+							->to_string() == pipelined_parser
+							.parse_pipelined(html)->to_string());
+					}
+				}
+			}
+		}
+	}
+}
+
+
+SCENARIO("parser collects parse statistics", "[parser]")
+{
+	GIVEN("parser with statistics enabled")
+	{
+		cpphtml::parse_stats stats;
+		cpphtml::parser parser;
+		parser.collect_stats(&stats);
+
+		WHEN("html is parsed")
+		{
+			std::string html = "<div id='a' class=b><ul><li>one<li>two"
+				"<br></ul><script>var a = '<p>';</script>"
+				"<img src=x /></div>";
+			parser.parse(html);
+
+			THEN("nodes, implied end tags and raw text are counted")
+			{
+				REQUIRE(stats.bytes_scanned == html.size());
+				REQUIRE(stats.elements == 7);
+				REQUIRE(stats.text_nodes == 3);
+				REQUIRE(stats.attributes == 3);
+				REQUIRE(stats.implied_end_tags == 2);
+				REQUIRE(stats.void_elements == 2);
+				REQUIRE(stats.raw_text_bytes == 14);
+				REQUIRE(stats.max_depth == 4);
+				// Attributes are stored inside their elements.
+				REQUIRE(stats.allocations >= 3 * (7 + 3));
+				REQUIRE(stats.total_time >= stats.tag_time
+					+ stats.text_time);
+			}
+
+			AND_WHEN("another html is parsed")
+			{
+				parser.reset();
+				parser.parse("<p>text</p>");
+
+				THEN("statistics are reset")
+				{
+					REQUIRE(stats.elements == 1);
+					REQUIRE(stats.text_nodes == 1);
+					REQUIRE(stats.implied_end_tags == 0);
+				}
+			}
+		}
+
+		WHEN("statistics are disabled")
+		{
+			parser.collect_stats(nullptr);
+			parser.parse("<p>text</p>");
+
+			THEN("they are not updated")
+			{
+				REQUIRE(stats.elements == 0);
+			}
+		}
+	}
+}
+
+
+SCENARIO("parser can parse attributes lazily", "[parser]")
+{
+	GIVEN("parser with lazy attributes parsing")
+	{
+		cpphtml::parser parser(cpphtml::parser::parse_default
+			| cpphtml::parser::parse_lazy_attributes);
+		std::string html = "<div Id='main' class=\"a > b\" hidden "
+			"data-x=1><img src=x.png/><br/><p>text</p><span title=a/>"
+			"x</span><i hidden/>y</div>";
+
+		WHEN("html is parsed")
+		{
+			auto doc = parser.parse(html);
+
+			THEN("attributes are the same as parsed eagerly")
+			{
+				cpphtml::parser eager_parser;
+				REQUIRE(dump_tree(doc) == dump_tree(
+					eager_parser.parse(html)));
+			}
+
+			THEN("it's serialized the same as parsed eagerly")
+			{
+				cpphtml::parser eager_parser;
+				REQUIRE(doc->to_string() == eager_parser.parse(html)
+					->to_string());
+				REQUIRE(doc->get_element_by_id("main")
+					->get_attribute("CLASS")->value() == "a > b");
+			}
+
+			THEN("attributes are parsed on first access")
+			{
+				auto div = doc->get_element_by_id("main");
+				REQUIRE(div);
+				REQUIRE(div->get_attribute("ID")->source_name()
+					== "Id");
+				REQUIRE(div->get_attribute("CLASS")->value()
+					== "a > b");
+				REQUIRE(div->get_attribute("HIDDEN")->value() == "");
+				REQUIRE(div->last_attribute()->value() == "1");
+			}
+
+			THEN("void and self-closing elements are closed")
+			{
+				auto div = doc->get_element_by_id("main");
+				REQUIRE(div->child_nodes().size() == 6);
+				REQUIRE(div->first_child()->get_attribute("SRC")
+					->value() == "x.png/");
+			}
+		}
+
+		WHEN("attribute is appended before attributes are accessed")
+		{
+			auto doc = parser.parse(html);
+			auto div = doc->first_child();
+			div->append_attribute("TITLE", "t");
+
+			THEN("it follows the parsed attributes")
+			{
+				REQUIRE(div->first_attribute()->name() == "ID");
+				REQUIRE(div->last_attribute()->name() == "TITLE");
+			}
+		}
+	}
+}
@@ -1,4 +1,7 @@
+#include <cstdint>
 #include <string>
+#include <vector>
+#include <map>
 
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
@@ -51,12 +54,12 @@ SCENARIO("token iterator can be created from string", "[token_iterator]")
 			THEN("token iterator points to string token")
 			{
 				REQUIRE(it_token->type
-					== cpphtml::token_type::start_tag);
+					== cpphtml::token_type::string);
 			}
 
-			THEN("token value is tag name")
+			THEN("token value is text before tag")
 			{
-				REQUIRE(it_token->value == "html");
+				REQUIRE(it_token->value == "html>");
 			}
 		}
 	}
@@ -69,15 +72,15 @@ SCENARIO("token iterator can be created from string", "[token_iterator]")
 		{
 			cpphtml::token_iterator it_token(str_html);
 
-			THEN("token iterator points to tag start token")
+			THEN("token iterator points to string token")
 			{
 				REQUIRE(it_token->type
-					== cpphtml::token_type::start_tag);
+					== cpphtml::token_type::string);
 			}
 
-			THEN("token value is tag name")
+			THEN("tag is tokenized as text")
 			{
-				REQUIRE(it_token->value == "div");
+				REQUIRE(it_token->value == "< div\t>");
 			}
 		}
 	}
@@ -104,4 +107,363 @@ SCENARIO("token iterator can be created from string", "[token_iterator]")
 			}
 		}
 	}
+
+	GIVEN("html with single tag")
+	{
+		std::string str_html{"<br>"};
+
+		WHEN("iterator is increased past the last tag")
+		{
+			cpphtml::token_iterator it_token{str_html};
+			REQUIRE(it_token.has_next());
+			++it_token;
+
+			THEN("iterator points to end of file token")
+			{
+				REQUIRE((*it_token).type
+					== cpphtml::token_type::end_of_file);
+				REQUIRE(!it_token.has_next());
+			}
+		}
+	}
+}
+
+
+/**
+ * @return positions of structural characters marked in blocks.
+ */
+static std::vector<std::size_t>
+bitmap_positions(const std::vector<cpphtml::structural_block>& blocks)
+{
+	std::vector<std::size_t> positions;
+	for (std::size_t i = 0; i < blocks.size() * 64; ++i) {
+		if (blocks[i / 64].structural & (std::uint64_t(1) << (i % 64))) {
+			positions.push_back(i);
+		}
+	}
+
+	return positions;
+}
+
+
+static std::string
+token_string(const std::string& str)
+{
+	return str;
+}
+
+
+static std::string
+token_string(const cpphtml::token_span& span)
+{
+	return span.str();
+}
+
+
+/**
+ * @return tokens as "type:value" strings. Attributes are appended as
+ *	" name=value" in name order.
+ */
+template <typename TokenIterator>
+static std::vector<std::string>
+collect_tokens(TokenIterator it_token)
+{
+	static const char* type_names[] = {"illegal", "doctype", "start_tag",
+		"end_tag", "comment", "string", "end_of_file"};
+
+	std::vector<std::string> tokens;
+	for (; it_token.has_next(); ++it_token) {
+		std::string str_token = std::string(type_names[
+			static_cast<int>(it_token->type)]) + ":"
+			+ token_string(it_token->value);
+
+		std::map<std::string, std::string> attributes;
+		for (auto& attr : it_token->attributes) {
+			attributes[token_string(attr.first)]
+				= token_string(attr.second);
+		}
+		for (auto& attr : attributes) {
+			str_token += " " + attr.first + "=" + attr.second;
+		}
+
+		tokens.push_back(str_token);
+	}
+
+	return tokens;
+}
+
+
+SCENARIO("indexed token iterator tokenizes html using structural index",
+	"[indexed_token_iterator]")
+{
+	GIVEN("html with white space runs and attributes")
+	{
+		std::string str_html{"a  <b c='d'>"};
+
+		WHEN("structural characters are indexed")
+		{
+			std::vector<cpphtml::structural_block> blocks;
+			cpphtml::index_structural_chars(str_html.data(),
+				str_html.size(), blocks);
+
+			THEN("symbols and white space run starts are indexed")
+			{
+				REQUIRE(bitmap_positions(blocks)
+					== (std::vector<std::size_t>{1, 3, 5, 7, 8, 10,
+					11}));
+			}
+		}
+	}
+
+	GIVEN("white space run crossing 64 character block boundary")
+	{
+		std::string str_html = "x" + std::string(70, ' ') + "<p>";
+
+		WHEN("structural characters are indexed")
+		{
+			cpphtml::indexed_token_iterator it_token(str_html);
+
+			THEN("only the first white space is indexed")
+			{
+				REQUIRE(bitmap_positions(it_token.structural_index())
+					== (std::vector<std::size_t>{1, 71, 73}));
+			}
+		}
+	}
+
+	GIVEN("html document")
+	{
+		std::string str_html{"<!DOCTYPE html><html><title>a<b</title>"
+			"<script>if (a<b) x=\"</div>\";</script><body "
+			"class=\"main page\" id=x data-v = 'q\"u' disabled>"
+			"<br/><p>Hello &amp; bye</p><!-- c<>-- -->x<</html>"};
+
+		WHEN("it's tokenized")
+		{
+			auto tokens = collect_tokens(
+				cpphtml::indexed_token_iterator(str_html));
+
+			THEN("all tokens are emitted")
+			{
+				REQUIRE(tokens == (std::vector<std::string>{
+					"doctype:html",
+					"start_tag:html",
+					"start_tag:title",
+					"string:a<b",
+					"end_tag:title",
+					"start_tag:script",
+					"string:if (a<b) x=\"</div>\";",
+					"end_tag:script",
+					"start_tag:body class=main page data-v=q\"u "
+						"disabled= id=x",
+					"start_tag:br",
+					"start_tag:p",
+					"string:Hello &amp; bye",
+					"end_tag:p",
+					"comment: c<>-- ",
+					"string:x",
+					"string:<",
+					"end_tag:html"}));
+			}
+		}
+	}
+
+	GIVEN("start tag with attributes and mixed case raw text element")
+	{
+		std::string str_html{"<a z=1 B='2' c><STYLE>p<b{}</Style>"};
+
+		WHEN("it's tokenized")
+		{
+			cpphtml::indexed_token_iterator it_token(str_html);
+
+			THEN("attributes are in document order")
+			{
+				auto& attributes = it_token->attributes;
+				REQUIRE(attributes.size() == 3);
+				REQUIRE(attributes[0].first.str() == "z");
+				REQUIRE(attributes[1].first.str() == "B");
+				REQUIRE(attributes[1].second.str() == "2");
+				REQUIRE(attributes[2].first.str() == "c");
+				REQUIRE(attributes[2].second.empty());
+			}
+
+			THEN("raw text element content is a single token")
+			{
+				REQUIRE(collect_tokens(it_token)
+					== (std::vector<std::string>{
+					"start_tag:a B=2 c= z=1",
+					"start_tag:STYLE",
+					"string:p<b{}",
+					"end_tag:Style"}));
+			}
+		}
+	}
+}
+
+
+SCENARIO("token iterator implements html5 tokenizer states",
+	"[token_iterator]")
+{
+	GIVEN("html document")
+	{
+		std::string str_html{"<!DOCTYPE html><HTML lang=en><title>a<b>"
+			"&amp;</title><script>if (a<b) x=\"</div>\";</script>"
+			"<body class=\"main page\" id=x data-v = 'q\"u' disabled "
+			"ID=dup><br/><p>Hello&nbsp;&#169;&#x41;&notit;&amp bye</p>"
+			"<!-- c<>- -->x<</html>"};
+
+		WHEN("it's tokenized")
+		{
+			auto tokens = collect_tokens(
+				cpphtml::token_iterator(str_html));
+
+			THEN("all html5 tokens are emitted")
+			{
+				REQUIRE(tokens == (std::vector<std::string>{
+					"doctype:html",
+					"start_tag:html lang=en",
+					"start_tag:title",
+					"string:a<b>&",
+					"end_tag:title",
+					"start_tag:script",
+					"string:if (a<b) x=\"</div>\";",
+					"end_tag:script",
+					"start_tag:body class=main page data-v=q\"u "
+						"disabled= id=x",
+					"start_tag:br",
+					"start_tag:p",
+					"string:Hello\xC2\xA0\xC2\xA9"
+						"A\xC2\xACit;& bye",
+					"end_tag:p",
+					"comment: c<>- ",
+					"string:x<",
+					"end_tag:html"}));
+			}
+		}
+	}
+
+	GIVEN("self closing tag")
+	{
+		std::string str_html{"<br/>"};
+
+		WHEN("it's tokenized")
+		{
+			cpphtml::token_iterator it_token(str_html);
+
+			THEN("token has self closing flag")
+			{
+				REQUIRE(it_token->type
+					== cpphtml::token_type::start_tag);
+				REQUIRE(it_token->self_closing);
+			}
+		}
+	}
+
+	GIVEN("doctype with public and system identifiers")
+	{
+		std::string str_html{"<!doctype HTML PUBLIC "
+			"\"-//W3C//DTD HTML 4.01//EN\" 'http://www.w3.org/TR/html4'>"};
+
+		WHEN("it's tokenized")
+		{
+			cpphtml::token_iterator it_token(str_html);
+
+			THEN("identifiers are set")
+			{
+				REQUIRE(it_token->type == cpphtml::token_type::doctype);
+				REQUIRE(it_token->value == "html");
+				REQUIRE(it_token->public_identifier
+					== "-//W3C//DTD HTML 4.01//EN");
+				REQUIRE(it_token->system_identifier
+					== "http://www.w3.org/TR/html4");
+				REQUIRE(!it_token->force_quirks);
+			}
+		}
+	}
+
+	GIVEN("html with character references in attribute values")
+	{
+		std::string str_html{"<a href='?a=1&amp;b=2&copy=3&lt'>"};
+
+		WHEN("it's tokenized")
+		{
+			cpphtml::token_iterator it_token(str_html);
+
+			THEN("legacy references followed by '=' are not decoded")
+			{
+				REQUIRE(it_token->attributes["href"]
+					== "?a=1&b=2&copy=3<");
+			}
+		}
+	}
+
+	GIVEN("text with references from the full WHATWG list")
+	{
+		std::string str_html{"&NotEqualTilde; &CounterClockwiseContourIntegral;"
+			" &fjlig; &Aacute &notin &notx &zzz;"};
+
+		WHEN("it's tokenized")
+		{
+			cpphtml::token_iterator it_token(str_html);
+
+			THEN("the longest matching reference is decoded")
+			{
+				REQUIRE(it_token->value == "\xE2\x89\x82\xCC\xB8 "
+					"\xE2\x88\xB3 fj \xC3\x81 \xC2\xACin "
+					"\xC2\xACx &zzz;");
+			}
+		}
+	}
+
+	GIVEN("html ending inside tag and comment")
+	{
+		WHEN("it's tokenized")
+		{
+			THEN("unfinished tag is dropped")
+			{
+				REQUIRE(collect_tokens(cpphtml::token_iterator(
+					"text<div class=")) == (std::vector<std::string>{
+					"string:text"}));
+			}
+
+			THEN("unfinished comment is emitted")
+			{
+				REQUIRE(collect_tokens(cpphtml::token_iterator(
+					"<!--text")) == (std::vector<std::string>{
+					"comment:text"}));
+			}
+		}
+	}
+
+	GIVEN("html with windows line breaks")
+	{
+		std::string str_html{"a\r\nb\rc"};
+
+		WHEN("it's tokenized")
+		{
+			cpphtml::token_iterator it_token(str_html);
+
+			THEN("line breaks are normalized")
+			{
+				REQUIRE(it_token->value == "a\nb\nc");
+			}
+		}
+	}
+
+	GIVEN("RCDATA content")
+	{
+		std::string str_html{"a&lt;</b></title>"};
+
+		WHEN("it's tokenized in RCDATA state")
+		{
+			auto tokens = collect_tokens(cpphtml::token_iterator(
+				str_html, cpphtml::tokenizer_state::rcdata, "title"));
+
+			THEN("only appropriate end tag ends text")
+			{
+				REQUIRE(tokens == (std::vector<std::string>{
+					"string:a<</b>", "end_tag:title"}));
+			}
+		}
+	}
 }